@@ -9,15 +9,28 @@
  */
 
 #include <iostream>
-#include <chrono>
-#include <cmath>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <algorithm>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
 #include "assembler/assembler.h"
 #include "entropy/entropy.h"
+#include "linker/module.h"
 #include "debug/debugger.h"
 #include "machine/machine.h"
+#include "optimizer/optimizer.h"
+#include "perf/counters.h"
+#include "profile/histogram.h"
+#include "profile/profiler.h"
+#include "profile/sampler.h"
+#include "stats/stats.h"
 #include "syntax/syntax.h"
+#include "trace/trace.h"
 
 #define VERSION_NUMBER "2.3.1"
 static const char *version_string = "Stackmachine VM version " VERSION_NUMBER " (compiled " __DATE__ ")";
@@ -33,8 +46,54 @@ static const char *help_page =
         "    execution, access to register values, access to memory and stack\n"
         "    values, as well as breakpoints for a program.\n"
         " -i, --information\n"
-        "    Print runtime information like execution time, time required to load the\n"
-        "    program and executed instructions per second.\n"
+        "    Print runtime information like execution time, time required for every\n"
+        "    phase of loading the program, executed instructions per second and the\n"
+        "    peak memory usage of the virtual machine.\n"
+        " --stats=text, --stats=json=[FILE]\n"
+        "    Like -i, but additionally record the maximum stack depth and the memory\n"
+        "    pages accessed by the program. Since every executed instruction is\n"
+        "    instrumented, execution is slower than with -i. The JSON document is\n"
+        "    written to FILE and includes the hardware counters of --perf-counters.\n"
+        " --perf-counters\n"
+        "    Like -i, but additionally collect hardware performance counters of\n"
+        "    the host during execution, such as cycles, branch misses and cache\n"
+        "    misses. Counters not permitted by the kernel are omitted.\n"
+        " -O, --optimize\n"
+        "    Remove instructions without effect, like nop or an instruction directly\n"
+        "    followed by its inverse, and fold computations only depending on\n"
+        "    constants before the program is assembled. Constants given with -D\n"
+        "    are folded as well. The number of removed instructions is reported.\n"
+        "    Removed instructions change the distances between instructions, so\n"
+        "    programs using such a distance as value, other than as operand of a\n"
+        "    call, may compute different results.\n"
+        " -O2\n"
+        "    Like -O, but additionally inline small procedures into the places they\n"
+        "    are called or uncalled from.\n"
+        " -D, --define [SYMBOL=VALUE]\n"
+        "    Replace the value of the constant SYMBOL, defined by a .set directive,\n"
+        "    with VALUE before the program is assembled. Combined with -c, the object\n"
+        "    files are written with the replaced value. It is an error if no input\n"
+        "    defines SYMBOL, in which case no object file is written.\n"
+        " -c, --compile\n"
+        "    Assemble every source FILE into a relocatable object file with the\n"
+        "    extension .rso instead of executing it. Symbols listed by an .export\n"
+        "    directive are visible to other modules.\n"
+        " -p, --profile [FILE]\n"
+        "    Record how often every instruction is executed forwards and backwards\n"
+        "    and how much time is spent on it. A report mapping these numbers to\n"
+        "    labels and source lines is written to FILE.\n"
+        " --sample-profile [HZ] [FILE]\n"
+        "    Sample the executed instruction and the active procedure frames HZ\n"
+        "    times per second of CPU time. Samples are written to FILE in the\n"
+        "    collapsed stack format accepted by flamegraph tools.\n"
+        " --opcode-histogram [FILE]\n"
+        "    Count every executed opcode per direction, as well as all pairs and\n"
+        "    triples of opcodes executed one after another. The counts are written\n"
+        "    to FILE as JSON document and added to the counts already in FILE.\n"
+        " -t, --trace [FILE]\n"
+        "    Record a compact binary trace of all branches, calls and direction\n"
+        "    changes to FILE, from which every executed instruction can be\n"
+        "    reconstructed using the stackmachine-trace tool.\n"
         " -e, -E\n"
         "    Display how much information is present in the machine state after\n"
         "    execution finished. To measure the amount of information, either the\n"
@@ -46,6 +105,12 @@ static const char *help_page =
         " -m, --memsize [SIZE]\n"
         "    Configures the amount of values the program memory can hold.\n"
         "\n"
+        "If multiple FILEs are given, or one of them is an object file, every source\n"
+        "file is assembled as module and all modules are linked in the given order.\n"
+        "\n"        "The options -d, -p, --sample-profile, -t, --opcode-histogram and --stats\n"
+        "each execute the program in their own way, so at most one of them can be\n"
+        "given.\n"
+        "\n"
         "Both [SIZE] arguments may be any number, optionally suffixed by a size unit.\n"
         "Supported units are: k (1024^1), m (1024^2), g (1024^3).\n"
         "\n"
@@ -67,22 +132,11 @@ static void display_version() {
 
 static void display_help(const char *progname) {
     cout << "A virtual machine for reversible stack machine programs.\n\n";
-    cout << "  " << progname << " " << "[OPTIONS] FILE\n\n";
+    cout << "  " << progname << " " << "[OPTIONS] FILE...\n\n";
+    cout << "If FILE is " << STDIN_FILENAME << ", the program is read from standard input.\n\n";
     cout << help_page << endl;
 }
 
-static void report_runtime_statistics(const Machine::VM &machine,
-                                      const std::chrono::duration<double> load_time,
-                                      const std::chrono::duration<double> run_time) noexcept {
-    cerr.precision(2);
-    cerr << std::fixed;
-    cerr << "Loaded program in " << (load_time.count() * 1000) << "ms.\n";
-    cerr << "Executed " << machine.counter << " instructions in " << (run_time.count() * 1000) << "ms" <<
-         " (~ " << (long) floor((double) machine.counter / run_time.count()) << " instr/s)\n";
-    cerr << endl;
-}
-
-
 static bool matches(const char *arg, std::initializer_list<const char *> potential_matches) {
     return std::ranges::any_of(potential_matches, [&arg](const char *element) {
         return strcmp(arg, element) == 0;
@@ -96,17 +150,23 @@ static bool parse_size(const char *arg, size_t &result) {
         char digit = *arg;
 
         if (isdigit(digit)) {
+            if (accumulator > (SIZE_MAX - 9) / 10) {
+                return false; // Too large to be represented.
+            }
             accumulator = accumulator * 10 + (digit - '0');
         } else {
             switch (digit) {
                 case 'g':
                 case 'G':
+                    if (accumulator > SIZE_MAX / 1024) return false;
                     accumulator *= 1024;
                 case 'm':
                 case 'M':
+                    if (accumulator > SIZE_MAX / 1024) return false;
                     accumulator *= 1024;
                 case 'k':
                 case 'K':
+                    if (accumulator > SIZE_MAX / 1024) return false;
                     accumulator *= 1024;
                     result = accumulator;
                     return true;
@@ -121,6 +181,96 @@ static bool parse_size(const char *arg, size_t &result) {
     return true;
 }
 
+/**
+ * Returns the name of the object file created for a source file.
+ */
+static std::string object_file_name(const char *source_file) {
+    return std::filesystem::path(source_file).replace_extension(".rso").string();
+}
+
+/**
+ * Options applied to every source file before it is assembled.
+ */
+struct LoadOptions {
+    unsigned optimization_level = 0;
+    std::vector<Optimizer::ConstantOverride> overrides;
+};
+
+/**
+ * Parses a source file, overrides its constants and applies all optimizations enabled by the optimization level.
+ */
+static Program load_program(const char *input_file, LoadOptions &options, Stats::PhaseTimes &times) {
+    const unsigned optimization_level = options.optimization_level;
+    auto start = Stats::Clock::now();
+    Program program = parse_file(input_file);
+    start = times.record("parse", start);
+    Optimizer::override_constants(program, options.overrides);
+    if (optimization_level >= 2) {
+        const size_t inlined = Optimizer::inline_procedures(program);
+        cerr << "Optimizer inlined " << inlined << " procedure calls in " << input_file << "." << endl;
+    }
+    if (optimization_level >= 1) {
+        const size_t removed = Optimizer::eliminate_redundant_instructions(program);
+        cerr << "Optimizer removed " << removed << " instructions from " << input_file << "." << endl;
+    }
+    if (optimization_level >= 1 || !options.overrides.empty()) {
+        times.record("optimize", start);
+    }
+    return program;
+}
+
+/**
+ * Assembles a source file as module, reporting errors with the name of the file.
+ */
+static Linker::Module assemble_module(const char *input_file, LoadOptions &options) {
+    try {
+        Stats::PhaseTimes times; // Modules are timed as a whole.
+        return Linker::assemble_module(load_program(input_file, options, times), input_file);
+    } catch (error_message &error) {
+        throw error_message(std::string(input_file) + ": " + error.getMessage());
+    }
+}
+
+/**
+ * Ensures every constant override was applied to at least one of the loaded programs.
+ */
+static void check_overrides(const LoadOptions &options) {
+    for (const auto &override: options.overrides) {
+        if (!override.is_applied) {
+            throw undefined_constant(override.symbol);
+        }
+    }
+}
+
+static void compile_modules(const std::vector<const char *> &input_files, LoadOptions &options) {
+    // All modules are assembled before the first one is written, so an unapplied override leaves no files behind.
+    std::vector<std::pair<const char *, Linker::Module>> modules;
+    for (const char *input_file: input_files) {
+        if (Linker::is_object_file(input_file)) {
+            continue; // Already compiled.
+        }
+        modules.emplace_back(input_file, assemble_module(input_file, options));
+    }
+    check_overrides(options);
+    for (const auto &[input_file, module]: modules) {
+        Linker::write_module(object_file_name(input_file), module);
+    }
+}
+
+static std::vector<Linker::Module> load_modules(const std::vector<const char *> &input_files,
+                                                LoadOptions &options) {
+    std::vector<Linker::Module> modules;
+    modules.reserve(input_files.size());
+    for (const char *input_file: input_files) {
+        if (Linker::is_object_file(input_file)) {
+            modules.push_back(Linker::read_module(input_file));
+        } else {
+            modules.push_back(assemble_module(input_file, options));
+        }
+    }
+    return modules;
+}
+
 #define REQUIRES_ARGS(n)                                                            \
     if (i + (n) >= argc) {                                                          \
         cerr << "Option requires at least " << (n) << "more arguments!" << endl;    \
@@ -130,17 +280,27 @@ static bool parse_size(const char *arg, size_t &result) {
 
 
 int main(int argc, char *argv[]) {
-    const char *input_file = nullptr;
+    std::vector<const char *> input_files;
+    const char *profile_file = nullptr;
+    const char *sample_file = nullptr;
+    const char *trace_file = nullptr;
+    const char *histogram_file = nullptr;
+    const char *statistics_file = nullptr;
     Entropy::Measure entropy_measure = Entropy::Measure::NONE;
     bool should_display_help = false,
             should_display_version = false,
             should_display_info = false,
+            should_record_usage = false,
+            should_count_events = false,
             should_be_quiet = false,
             is_debugger_enabled = false,
+            should_compile = false,
             path_separator = false,
             user_error = false;
+    LoadOptions load_options;
     size_t memory_size = 102400,
             stack_size = 1024;
+    unsigned int sample_frequency = 0;
 
     for (int i = 1; i < argc; i++) {
         const char *current_arg = argv[i];
@@ -151,10 +311,67 @@ int main(int argc, char *argv[]) {
             should_display_version = true;
         } else if (!path_separator && matches(current_arg, {"--information", "-i"})) {
             should_display_info = true;
+        } else if (!path_separator && matches(current_arg, {"--stats", "--stats=text"})) {
+            should_display_info = true;
+            should_record_usage = true;
+        } else if (!path_separator && strncmp(current_arg, "--stats=json", strlen("--stats=json")) == 0) {
+            should_display_info = true;
+            should_record_usage = true;
+            if (strncmp(current_arg, "--stats=json=", strlen("--stats=json=")) == 0 &&
+                current_arg[strlen("--stats=json=")] != '\0') {
+                statistics_file = current_arg + strlen("--stats=json=");
+            } else {
+                cerr << "Option --stats=json requires a file, given as --stats=json=FILE." << endl;
+                user_error = true;
+            }
+        } else if (!path_separator && matches(current_arg, {"--perf-counters"})) {
+            should_display_info = true;
+            should_count_events = true;
         } else if (!path_separator && matches(current_arg, {"--quiet", "-q"})) {
             should_be_quiet = true;
         } else if (!path_separator && matches(current_arg, {"--debug", "-d"})) {
             is_debugger_enabled = true;
+        } else if (!path_separator && matches(current_arg, {"--optimize", "-O"})) {
+            load_options.optimization_level = 1;
+        } else if (!path_separator && matches(current_arg, {"-O2"})) {
+            load_options.optimization_level = 2;
+        } else if (!path_separator && matches(current_arg, {"--define", "-D"})) {
+            REQUIRES_ARGS(1);
+            i += 1;
+            Optimizer::ConstantOverride override;
+            if (Optimizer::parse_override(argv[i], override)) {
+                load_options.overrides.push_back(override);
+            } else {
+                cerr << "Invalid constant definition: " << argv[i] << endl;
+                user_error = true;
+            }
+        } else if (!path_separator && matches(current_arg, {"--compile", "-c"})) {
+            should_compile = true;
+
+        } else if (!path_separator && matches(current_arg, {"--profile", "-p"})) {
+            REQUIRES_ARGS(1);
+            i += 1;
+            profile_file = argv[i];
+        } else if (!path_separator && matches(current_arg, {"--trace", "-t"})) {
+            REQUIRES_ARGS(1);
+            i += 1;
+            trace_file = argv[i];
+        } else if (!path_separator && matches(current_arg, {"--opcode-histogram"})) {
+            REQUIRES_ARGS(1);
+            i += 1;
+            histogram_file = argv[i];
+        } else if (!path_separator && matches(current_arg, {"--sample-profile"})) {
+            REQUIRES_ARGS(2);
+            i += 2;
+            sample_file = argv[i];
+            size_t frequency;
+            if (!parse_size(argv[i - 1], frequency) || frequency == 0 || frequency > Profiler::MAXIMUM_FREQUENCY) {
+                cerr << "Invalid sampling frequency: " << argv[i - 1]
+                     << " (must be between 1 and " << Profiler::MAXIMUM_FREQUENCY << " Hz)" << endl;
+                user_error = true;
+            } else {
+                sample_frequency = static_cast<unsigned int>(frequency);
+            }
 
         } else if (!path_separator && matches(current_arg, {"--stacksize", "-s"})) {
             REQUIRES_ARGS(1);
@@ -178,16 +395,12 @@ int main(int argc, char *argv[]) {
 
         } else if (!path_separator && strcmp(current_arg, "--") == 0) {
             path_separator = true;
-        } else if (!path_separator && current_arg[0] == '-') {
+        } else if (!path_separator && current_arg[0] == '-' && strcmp(current_arg, STDIN_FILENAME) != 0) {
             user_error = true;
             cerr << "Unknown option: " << current_arg << endl;
 
-        } else if (input_file == nullptr) {
-            input_file = current_arg;
         } else {
-            user_error = true;
-            cerr << "Only a single input file is allowed. "
-                    "Provided: '" << input_file << "' and '" << current_arg << "' !" << endl;
+            input_files.push_back(current_arg);
         }
     }
 
@@ -199,27 +412,125 @@ int main(int argc, char *argv[]) {
     if (should_display_help || should_display_version)
         return 0;
 
-    if (input_file == nullptr) {
+    const bool reads_stdin = std::any_of(input_files.begin(), input_files.end(), [](const char *file) {
+        return strcmp(file, STDIN_FILENAME) == 0;
+    });
+    if (input_files.empty()) {
         user_error = true;
         cerr << "No input file" << endl;
+    } else if (is_debugger_enabled && reads_stdin) {
+        user_error = true;
+        cerr << "The debugger reads commands from standard input and cannot be used with a program read from it." << endl;
+    } else if (should_compile && reads_stdin) {
+        user_error = true;
+        cerr << "Standard input cannot be compiled to an object file." << endl;
+    }
+
+    // Each of these options executes the program with its own loop, so at most one of them can be used.
+    const std::pair<const char *, bool> execution_modes[] = {
+            {"--debug", is_debugger_enabled},
+            {"--profile", profile_file != nullptr},
+            {"--sample-profile", sample_file != nullptr},
+            {"--trace", trace_file != nullptr},
+            {"--opcode-histogram", histogram_file != nullptr},
+            {"--stats", should_record_usage},
+    };
+    const char *execution_mode = nullptr;
+    for (const auto &[option, is_selected]: execution_modes) {
+        if (!is_selected) continue;
+        if (execution_mode != nullptr) {
+            user_error = true;
+            cerr << "Options " << execution_mode << " and " << option << " cannot be combined." << endl;
+            break;
+        }
+        execution_mode = option;
     }
     if (user_error)
         return 2;
 
     try {
-        const auto load_start = std::chrono::high_resolution_clock::now();
-        Program program = parse_file(input_file);
-        const auto &[memory, code, entry_address] = assemble(program);
+        if (should_compile) {
+            compile_modules(input_files, load_options);
+            return 0;
+        }
+
+        Stats::Statistics statistics;
+        Stats::PhaseTimes &load_times = statistics.load_times;
+        auto load_start = Stats::Clock::now();
+        // A single source file is assembled directly. Otherwise all inputs are linked as modules.
+        std::optional<Program> program;
+        MemoryLayout memory;
+        std::vector<int32_t> code;
+        int32_t entry_address;
+        if (input_files.size() == 1 && !Linker::is_object_file(input_files.front())) {
+            program.emplace(load_program(input_files.front(), load_options, load_times));
+            std::tie(memory, code, entry_address) = assemble(program.value(), load_times);
+        } else {
+            std::tie(memory, code, entry_address) = Linker::link(load_modules(input_files, load_options));
+            load_times.record("link", load_start);
+        }
+        check_overrides(load_options);
+        load_start = Stats::Clock::now();
         Machine::VM machine(code, memory, memory_size, stack_size, entry_address);
-        const auto load_stop = std::chrono::high_resolution_clock::now();
+        load_times.record("initialize", load_start);
 
-        const auto exec_start = std::chrono::system_clock::now();
-        if (!is_debugger_enabled) machine.run();
-        else Machine::run_with_debugger(machine);
-        const auto exec_stop = std::chrono::system_clock::now();
+        if ((profile_file != nullptr || sample_file != nullptr) && !program.has_value()) {
+            cerr << "[WARNING] Profiles require a single source file and are not recorded for linked programs." << endl;
+        }
+        const bool is_profiler_enabled = profile_file != nullptr && program.has_value();
+        const bool is_sampler_enabled = sample_file != nullptr && program.has_value();
+        const bool is_tracer_enabled = trace_file != nullptr;
+        const bool is_histogram_enabled = histogram_file != nullptr;
+        if (should_record_usage) {
+            statistics.usage.emplace(machine);
+        }
+        Profiler::Profile profile(is_profiler_enabled ? code.size() : 0);
+        Profiler::SampleBuffer samples(is_sampler_enabled ? 1 << 18 : 0);
+        std::optional<Profiler::OpcodeHistogram> histogram;
+        if (is_histogram_enabled) histogram.emplace();
+        std::optional<Trace::Writer> trace;
+        if (is_tracer_enabled) trace.emplace(trace_file);
+
+        std::optional<Perf::Counters> counters;
+        if (should_count_events) counters.emplace();
+
+        if (counters.has_value()) counters->start();
+        const auto exec_start = Stats::Clock::now();
+        if (is_debugger_enabled) Machine::run_with_debugger(machine);
+        else if (is_profiler_enabled) Profiler::run_with_profiler(machine, profile);
+        else if (is_sampler_enabled) Profiler::run_with_sampler(machine, sample_frequency, samples);
+        else if (is_tracer_enabled) Trace::run_with_tracer(machine, trace.value());
+        else if (is_histogram_enabled) Profiler::run_with_histogram(machine, histogram.value());
+        else if (statistics.usage.has_value()) Stats::run_with_statistics(machine, statistics.usage.value());
+        else machine.run();
+        statistics.run_time = Stats::Clock::now() - exec_start;
+        if (counters.has_value()) counters->stop();
+
+        if (is_profiler_enabled) {
+            Profiler::write_profile(profile_file, profile, Profiler::SourceMap(program.value()));
+        }
+        if (is_sampler_enabled) {
+            Profiler::write_collapsed_stacks(sample_file, samples, Profiler::SourceMap(program.value()));
+        }
+        if (is_histogram_enabled) {
+            Profiler::write_histogram(histogram_file, histogram.value());
+        }
 
         if (should_display_info) {
-            report_runtime_statistics(machine, load_stop - load_start, exec_stop - exec_start);
+            statistics.instructions = machine.counter;
+            statistics.stack_size = stack_size;
+            statistics.memory_size = memory_size;
+            if (statistics_file != nullptr) {
+                if (counters.has_value()) statistics.counters = &counters.value();
+                std::ofstream output(statistics_file);
+                if (!output) {
+                    throw std::invalid_argument("File " + std::string(statistics_file) + " cannot be opened for writing.");
+                }
+                Stats::write_statistics_json(output, statistics);
+            } else {
+                Stats::report_statistics(cerr, statistics);
+                if (counters.has_value()) Perf::report_counters(counters.value(), machine.counter);
+            }
         }
 
         if (entropy_measure != Entropy::Measure::NONE) {
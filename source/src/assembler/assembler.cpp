@@ -6,11 +6,22 @@ namespace Assembler {
 
     [[nodiscard]] std::tuple<MemoryLayout, std::vector<int32_t>, int32_t> assemble(
             Program &program) {
+        Stats::PhaseTimes times;
+        return assemble(program, times);
+    }
+
+    [[nodiscard]] std::tuple<MemoryLayout, std::vector<int32_t>, int32_t> assemble(
+            Program &program, Stats::PhaseTimes &times) {
         MemoryLayout memory;
+        AddressRanges reserved_ranges;
 
-        const SymbolTable table = resolve_symbols(program, memory, 0);
+        auto start = Stats::Clock::now();
+        const SymbolTable table = resolve_symbols(program, reserved_ranges, 0);
+        start = times.record("resolve", start);
         build_memory(program, table, memory);
+        start = times.record("memory", start);
         const auto &[code, entry_address] = translate_program(program, table);
+        times.record("translate", start);
         return {memory, code, entry_address};
     }
 }
@@ -11,16 +11,133 @@
  * @see std::tuple<MemoryLayout, std::vector<int32_t>, int32_t> assemble(Program &program)
  */
 
+#include <algorithm>
+#include <cstdint>
 #include <map>
 #include <string>
 #include <optional>
+#include <vector>
 #include "syntax/syntax.h"
+#include "syntax/instructions.h"
 #include "messages/error.h"
+#include "stats/phases.h"
 
 namespace Assembler {
 
-    using SymbolTable = std::map<std::string, int32_t>;
-    using MemoryLayout = std::map<int32_t, int32_t>;
+    /**
+     * Maps symbols to their values. Since symbols are interned by the parser, the
+     * table is a flat array indexed by symbol ids and lookups do not compare strings.
+     */
+    class SymbolTable {
+        struct Entry {
+            int32_t value;
+            bool defined;
+        };
+
+        std::vector<Entry> entries;
+
+    public:
+        [[nodiscard]] bool contains(const char *symbol) const {
+            const uint32_t id = symbolId(symbol);
+            return id < entries.size() && entries[id].defined;
+        }
+
+        [[nodiscard]] int32_t at(const char *symbol) const {
+            return entries[symbolId(symbol)].value;
+        }
+
+        void define(const char *symbol, int32_t value) {
+            const uint32_t id = symbolId(symbol);
+            if (id >= entries.size()) {
+                entries.resize(std::max<size_t>(symbolCount(), id + 1), Entry{0, false});
+            }
+            entries[id] = Entry{value, true};
+        }
+    };
+
+    /**
+     * The initial memory image of a program. Initialized words are stored as
+     * contiguous segments in a single arena, so the image can be loaded into
+     * machine memory segment by segment and shared read-only between machines.
+     * Words not covered by any segment are default initialized with 0.
+     */
+    class MemoryLayout {
+    public:
+        struct Segment {
+            int32_t base_address;
+            size_t offset; // Offset of the first word in the arena.
+            size_t size;
+
+            [[nodiscard]] int64_t end_address() const { return base_address + static_cast<int64_t>(size); }
+        };
+
+    private:
+        std::vector<int32_t> arena;
+        std::vector<Segment> segment_list;
+        // Addresses reserved without initial values, which are not stored in any segment.
+        int64_t reserved_min = INT64_MAX, reserved_end = INT64_MIN;
+
+    public:
+        /**
+         * Stores a word in the image. Consecutive stores to ascending addresses extend
+         * the current segment, all other stores start a new one.
+         */
+        void store(int32_t address, int32_t value);
+
+        /**
+         * Reserves words without storing initial values, so they are covered by
+         * min_address() and end_address().
+         */
+        void reserve(int32_t address, size_t size);
+
+        /**
+         * Sorts segments by address and merges adjacent ones. Must be called after
+         * the last store and before the image is read. No address may have been
+         * stored twice.
+         */
+        void seal();
+
+        [[nodiscard]] bool empty() const { return segment_list.empty() && reserved_end == INT64_MIN; }
+
+        /**
+         * Returns the lowest address of all stored and reserved words. Must not be called on an empty layout.
+         */
+        [[nodiscard]] int32_t min_address() const;
+
+        /**
+         * Returns the address behind all stored and reserved words. Must not be called on an empty layout.
+         */
+        [[nodiscard]] int64_t end_address() const;
+
+        [[nodiscard]] const std::vector<Segment> &segments() const { return segment_list; }
+
+        [[nodiscard]] const int32_t *data(const Segment &segment) const { return arena.data() + segment.offset; }
+
+        /**
+         * Returns the initial value of a word, which is 0 for uninitialized words.
+         */
+        [[nodiscard]] int32_t at(int32_t address) const;
+    };
+
+    /**
+     * A set of disjoint address ranges, used to keep track of reserved memory areas.
+     * Ranges are stored as extents, so the cost of reserving a range does not
+     * depend on its size. Adjacent ranges are merged.
+     */
+    class AddressRanges {
+        std::map<int32_t, int64_t> ranges; // Maps the first address of a range to the address behind it.
+
+    public:
+        [[nodiscard]] bool contains(int32_t address) const;
+
+        /**
+         * Returns the lowest address not below base_address, where size consecutive
+         * addresses are not reserved yet.
+         */
+        [[nodiscard]] int64_t find_free(int32_t base_address, int32_t size) const;
+
+        void reserve(int32_t address, int32_t size);
+    };
 
     /**
      * Evaluate an Operand that is either a constant or combines only constants.
@@ -40,24 +157,40 @@ namespace Assembler {
 
     /**
      * Constructs a SymbolTable from the given program. This will reserve memory areas in the
-     * MemoryLayout and create entries for every defined symbol in the SymbolTable.
+     * given AddressRanges and create entries for every defined symbol in the SymbolTable.
      *
      * @param program The Program defining symbols and elements to layout in memory.
-     * @param memory_layout The memory layout in which areas are reserved.
+     * @param reserved_ranges The address ranges in which areas are reserved.
      * @param base_address The base address used to layout memory areas.
      * @return A new SymbolTable holding values for every defined symbol.
      */
-    [[nodiscard]] SymbolTable resolve_symbols(Program &program, MemoryLayout &memory_layout, int32_t base_address);
+    [[nodiscard]] SymbolTable resolve_symbols(Program &program, AddressRanges &reserved_ranges, int32_t base_address);
 
     /**
      * Fills the reserved memory areas with their associated values.
      *
      * @param program The program defining values for different memory areas.
      * @param symbol_table The SymbolTable used to resolve the values of symbolic operands in memory.
-     * @param memory_layout The MemoryLayout updated with values.
+     * @param memory_layout The MemoryLayout updated with values. It is sealed afterwards.
      */
     void build_memory(const Program &program, const SymbolTable &symbol_table, MemoryLayout &memory_layout);
 
+    /**
+     * Encodes an instruction as bit-pattern, using the operand mode of the instruction
+     * to derive the encoded operand from the given value.
+     *
+     * @param instruction The instruction to encode.
+     * @param operand The value of the instructions operand.
+     * @param position The address of the instruction, used for relative operands.
+     */
+    [[nodiscard]] int32_t encode_instruction(const InstructionData &instruction, int32_t operand, int32_t position);
+
+    /**
+     * Creates the warning reported, if an operand is given to an instruction not accepting operands.
+     */
+    [[nodiscard]] std::string discarded_operand_warning(const InstructionData &instruction, int32_t operand,
+                                                        int32_t linenumber);
+
     /**
      * Translates all Instructions in a program to their corresponding bit-patterns, resolving
      * instruction opcodes and operand values.
@@ -78,4 +211,11 @@ namespace Assembler {
      * of instructions and the programs entry point.
      */
     [[nodiscard]] std::tuple<MemoryLayout, std::vector<int32_t>, int32_t> assemble(Program &program);
+
+    /**
+     * Assembles the given Program like assemble(Program &program), recording the time spent on
+     * resolving symbols, building memory and translating instructions in the given PhaseTimes.
+     */
+    [[nodiscard]] std::tuple<MemoryLayout, std::vector<int32_t>, int32_t> assemble(Program &program,
+                                                                                   Stats::PhaseTimes &times);
 }
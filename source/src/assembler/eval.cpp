@@ -35,7 +35,7 @@ namespace Assembler {
     [[nodiscard]] static int32_t eval(const PrimitiveOperand &operand, const int32_t position, const SymbolTable &symbol_table) {
         switch (operand.variant) {
             case PRIMITIVE_SYMBOL: {
-                std::string symbol = operand.value.symbol;
+                const char *symbol = operand.value.symbol;
                 if (symbol_table.contains(symbol)) {
                     return symbol_table.at(symbol);
                 } else {
@@ -2,10 +2,85 @@
  * Initializes a MemoryLayout, placing all sections of a program in it.
  */
 
+#include <algorithm>
+#include <stdexcept>
+#include <string>
 #include "assembler.h"
 
 namespace Assembler {
 
+    void MemoryLayout::store(int32_t address, int32_t value) {
+        if (segment_list.empty() || segment_list.back().end_address() != address ||
+            segment_list.back().offset + segment_list.back().size != arena.size()) {
+            segment_list.push_back({address, arena.size(), 0});
+        }
+        arena.push_back(value);
+        segment_list.back().size++;
+    }
+
+    void MemoryLayout::reserve(int32_t address, size_t size) {
+        if (size == 0) return;
+        reserved_min = std::min<int64_t>(reserved_min, address);
+        reserved_end = std::max<int64_t>(reserved_end, address + static_cast<int64_t>(size));
+    }
+
+    int32_t MemoryLayout::min_address() const {
+        if (segment_list.empty()) return static_cast<int32_t>(reserved_min);
+        return static_cast<int32_t>(std::min<int64_t>(segment_list.front().base_address, reserved_min));
+    }
+
+    int64_t MemoryLayout::end_address() const {
+        if (segment_list.empty()) return reserved_end;
+        return std::max(segment_list.back().end_address(), reserved_end);
+    }
+
+    void MemoryLayout::seal() {
+        if (std::is_sorted(segment_list.begin(), segment_list.end(), [](const Segment &a, const Segment &b) {
+            return a.base_address < b.base_address;
+        }) && std::adjacent_find(segment_list.begin(), segment_list.end(), [](const Segment &a, const Segment &b) {
+            return a.end_address() >= b.base_address;
+        }) == segment_list.end()) {
+            return; // Already sorted and disjoint.
+        }
+
+        std::sort(segment_list.begin(), segment_list.end(), [](const Segment &a, const Segment &b) {
+            return a.base_address < b.base_address;
+        });
+
+        // Copy segments into a fresh arena in address order, merging adjacent ones. Segments never
+        // overlap, since the resolver and the linker reject words placed at the same address twice.
+        std::vector<int32_t> sorted_arena;
+        std::vector<Segment> merged;
+        sorted_arena.reserve(arena.size());
+        for (const Segment &segment: segment_list) {
+            if (!merged.empty() && merged.back().end_address() > segment.base_address) {
+                throw std::logic_error("Memory segments overlap at address " +
+                                       std::to_string(segment.base_address) + ".");
+            }
+            if (merged.empty() || merged.back().end_address() < segment.base_address) {
+                merged.push_back({segment.base_address, sorted_arena.size(), 0});
+            }
+
+            sorted_arena.insert(sorted_arena.end(), arena.begin() + static_cast<std::ptrdiff_t>(segment.offset),
+                                arena.begin() + static_cast<std::ptrdiff_t>(segment.offset + segment.size));
+            merged.back().size += segment.size;
+        }
+
+        arena = std::move(sorted_arena);
+        segment_list = std::move(merged);
+    }
+
+    int32_t MemoryLayout::at(int32_t address) const {
+        auto it = std::upper_bound(segment_list.begin(), segment_list.end(), address,
+                                   [](int32_t address, const Segment &segment) {
+                                       return address < segment.base_address;
+                                   });
+        if (it == segment_list.begin())
+            return 0;
+        --it;
+        return address < it->end_address() ? arena[it->offset + (address - it->base_address)] : 0;
+    }
+
     static void buildMemorySection(const Section &section, const SymbolTable &symbol_table,
                                    MemoryLayout &memory_layout) {
         iterate_section(section, [&](const Line &line) {
@@ -14,7 +89,7 @@ namespace Assembler {
                     int32_t offset = 0;
                     for (OperandList *list = line.value.words.data; !list->isEmpty; list = list->tail) {
                         const int32_t address = line.base_address + offset;
-                        memory_layout[address] = eval(list->head, address, symbol_table);
+                        memory_layout.store(address, eval(list->head, address, symbol_table));
 
                         offset++;
                     }
@@ -24,13 +99,17 @@ namespace Assembler {
                 case LINE_SET:
                     // .set SYMBOL VALUE is already initialized in Symbol Table, doesn't appear in memory.
                     if (line.value.setValue.memoryAddress.variant != PRIMITIVE_SYMBOL) {
-                        memory_layout[line.base_address] = eval(line.value.setValue.value,
-                                                                line.base_address, symbol_table);
+                        memory_layout.store(line.base_address, eval(line.value.setValue.value,
+                                                                    line.base_address, symbol_table));
                     }
                     break;
 
+                case LINE_RESERVED:
+                    // Left default initialized, but the reserved words must fit into memory.
+                    memory_layout.reserve(line.base_address, restrict_eval(line.value.reserved.size));
+                    break;
+
                 default:
-                    // Leave default initialized.
                     break;
             }
         });
@@ -39,6 +118,7 @@ namespace Assembler {
     void build_memory(const Program &program, const SymbolTable &symbol_table, MemoryLayout &memory_layout) {
         buildMemorySection(program.data, symbol_table, memory_layout);
         buildMemorySection(program.bss, symbol_table, memory_layout);
+        memory_layout.seal();
         // program.code is not processed here, since it is stored
         // in a separate program memory. (see translation.cpp)
     }
@@ -4,43 +4,80 @@
  * and reserving memory space for symbols.
  */
 
+#include <algorithm>
+#include <iterator>
 #include <stdexcept>
 #include "assembler.h"
 #include "messages/error.h"
 
 namespace Assembler {
 
-    constexpr int32_t DEFAULT_MEMORY_VALUE = 0;
+    bool AddressRanges::contains(int32_t address) const {
+        auto it = ranges.upper_bound(address);
+        if (it == ranges.begin())
+            return false;
+        --it;
+        return address < it->second;
+    }
 
-    [[nodiscard]] static int32_t allocate_range(MemoryLayout &memory_layout, int32_t &base_address, size_t size) {
-        bool collided;
-        int32_t castedSize;
+    int64_t AddressRanges::find_free(int32_t base_address, int32_t size) const {
+        int64_t address = base_address;
 
-        do {
-            collided = false; // Begin a new search round.
+        // Start behind a range covering the base address.
+        auto it = ranges.upper_bound(base_address);
+        if (it != ranges.begin() && std::prev(it)->second > address) {
+            address = std::prev(it)->second;
+        }
 
-            castedSize = static_cast<int32_t>(size);
-            if (castedSize < 0 || (base_address + castedSize) < 0)
-                throw std::out_of_range("Requested memory cannot be allocated with current layout.");
+        // Ranges are disjoint and sorted, so every collision moves the candidate forward.
+        while (it != ranges.end() && it->first < address + size) {
+            address = std::max(address, it->second);
+            ++it;
+        }
+        return address;
+    }
 
-            // Check if range collides with any allocated address in memory layout.
-            for (int32_t address = base_address + castedSize - 1; address >= base_address; address--) {
-                if (memory_layout.contains(address)) {
-                    base_address = address + 1;
-                    collided = true;
-                    break; // Try again.
-                }
-            }
-        } while (collided);
+    void AddressRanges::reserve(int32_t address, int32_t size) {
+        if (size <= 0)
+            return;
+
+        int64_t first = address;
+        int64_t last = first + size;
 
-        // Reserve memory range in layout.
-        for (int32_t address = base_address; address < base_address + castedSize; address++) {
-            memory_layout[address] = DEFAULT_MEMORY_VALUE;
+        // Merge with a preceding range that overlaps or is adjacent.
+        auto it = ranges.upper_bound(address);
+        if (it != ranges.begin() && std::prev(it)->second >= first) {
+            --it;
+            first = it->first;
+            last = std::max(last, it->second);
+            it = ranges.erase(it);
         }
 
+        // Merge with all following ranges that overlap or are adjacent.
+        while (it != ranges.end() && it->first <= last) {
+            last = std::max(last, it->second);
+            it = ranges.erase(it);
+        }
+
+        ranges.emplace(static_cast<int32_t>(first), last);
+    }
+
+    [[nodiscard]] static int32_t allocate_range(AddressRanges &reserved_ranges, int32_t &base_address, size_t size) {
+        const auto castedSize = static_cast<int32_t>(size);
+        if (castedSize < 0)
+            throw std::out_of_range("Requested memory cannot be allocated with current layout.");
+
+        // Skip over all reserved ranges colliding with the requested range.
+        const int64_t address = reserved_ranges.find_free(base_address, castedSize);
+        if (address + castedSize > INT32_MAX)
+            throw std::out_of_range("Requested memory cannot be allocated with current layout.");
+
+        // Reserve memory range. Reserved memory is default initialized by the machine.
+        const auto result = static_cast<int32_t>(address);
+        reserved_ranges.reserve(result, castedSize);
+
         // Move base_address for next allocation.
-        int32_t result = base_address;
-        base_address += castedSize;
+        base_address = result + castedSize;
         return result;
     }
 
@@ -49,7 +86,7 @@ namespace Assembler {
             throw symbol_redefinition_error(symbol);
         }
 
-        symbol_table[symbol] = value;
+        symbol_table.define(symbol, value);
     }
 
     static void enter_symbols(SymbolTable &symbol_table, Line &line, int32_t address) {
@@ -64,16 +101,16 @@ namespace Assembler {
     /**
      * Layout all Lines in a section with Line.variant == LINE_SET.
      */
-    static void layout_fixed(MemoryLayout &memory_layout, SymbolTable &symbol_table, Section &section) {
+    static void layout_fixed(AddressRanges &reserved_ranges, SymbolTable &symbol_table, Section &section) {
         iterate_section(section, [&](Line &line) {
             if (line.variant == LINE_SET && line.value.setValue.memoryAddress.variant != PRIMITIVE_SYMBOL) {
                 const int32_t address = restrict_eval(line.value.setValue.memoryAddress);
 
-                if (memory_layout.contains(address)) {
+                if (reserved_ranges.contains(address)) {
                     throw set_address_clash(address);
                 }
 
-                memory_layout[address] = DEFAULT_MEMORY_VALUE;
+                reserved_ranges.reserve(address, 1);
                 enter_symbols(symbol_table, line, address);
             } else if (line.variant == LINE_SET) {
                 const int32_t value = restrict_eval(line.value.setValue.value);
@@ -88,7 +125,7 @@ namespace Assembler {
      * Layout all Lines in a section with a Line.variant matching the given
      * bitmask.
      */
-    static void layout_section(MemoryLayout &memory_layout, SymbolTable &symbol_table,
+    static void layout_section(AddressRanges &reserved_ranges, SymbolTable &symbol_table,
                                Section &section, int32_t &base_address,
                                const LineVariant allowed_mask) {
         iterate_section(section, [&](Line &line) {
@@ -104,7 +141,7 @@ namespace Assembler {
 
                 case LINE_RESERVED: {
                     const int32_t size = restrict_eval(line.value.reserved.size);
-                    const int32_t allocatedAddress = allocate_range(memory_layout, base_address, size);
+                    const int32_t allocatedAddress = allocate_range(reserved_ranges, base_address, size);
                     enter_symbols(symbol_table, line, allocatedAddress);
                     break;
                 }
@@ -115,7 +152,7 @@ namespace Assembler {
                         size++;
                     }
 
-                    const int32_t allocatedAddress = allocate_range(memory_layout, base_address, size);
+                    const int32_t allocatedAddress = allocate_range(reserved_ranges, base_address, size);
                     enter_symbols(symbol_table, line, allocatedAddress);
                     break;
                 }
@@ -126,17 +163,17 @@ namespace Assembler {
         });
     }
 
-    [[nodiscard]] SymbolTable resolve_symbols(Program &program, MemoryLayout &memory_layout, int32_t base_address) {
+    [[nodiscard]] SymbolTable resolve_symbols(Program &program, AddressRanges &reserved_ranges, int32_t base_address) {
         SymbolTable symbol_table;
 
-        layout_fixed(memory_layout, symbol_table, program.data);
-        layout_section(memory_layout, symbol_table, program.data, base_address,
+        layout_fixed(reserved_ranges, symbol_table, program.data);
+        layout_section(reserved_ranges, symbol_table, program.data, base_address,
                        static_cast<LineVariant>(LINE_WORDS | LINE_SET));
-        layout_section(memory_layout, symbol_table, program.bss, base_address,
+        layout_section(reserved_ranges, symbol_table, program.bss, base_address,
                        LINE_RESERVED);
 
         int instruction_count = 0; // Create a fresh counter for instructions starting at 0.
-        layout_section(memory_layout, symbol_table, program.code, instruction_count, LINE_INSTRUCTION);
+        layout_section(reserved_ranges, symbol_table, program.code, instruction_count, LINE_INSTRUCTION);
 
         return symbol_table;
     }
@@ -1,73 +1,186 @@
 
-#include <cstring>
-#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <string>
+#include <thread>
 #include "assembler.h"
 #include "syntax/instructions.h"
 
 namespace Assembler {
-    using std::cerr, std::endl;
 
-    [[nodiscard]] std::tuple<std::vector<int32_t>, int32_t> translate_program(
-            const Program &program, const SymbolTable &symbol_table) {
-        std::vector<int32_t> result;
+    /**
+     * Programs with fewer instructions than this per thread are translated
+     * by fewer threads, since starting a thread costs more than translating them.
+     */
+    constexpr size_t MINIMUM_LINES_PER_THREAD = 16 * 1024;
+
+    constexpr int32_t START_BINARY = 0;
+    constexpr int32_t STOP_BINARY = INVERSE(START_BINARY);
+
+    /**
+     * Result of translating a contiguous range of lines. Each range is translated
+     * independently and the results are combined in line order afterwards, so
+     * errors and warnings are reported exactly as in a sequential translation.
+     */
+    struct TranslatedChunk {
+        size_t begin, end;
+
+        // Indices of the first two start and stop instructions, which is enough to detect duplicates.
+        std::vector<size_t> starts, stops;
+
+        // Index and exception of the first line that failed translation, if any.
+        size_t error_index = SIZE_MAX;
+        std::exception_ptr error;
+
+        std::vector<std::pair<size_t, std::string>> warnings;
+    };
+
+    [[nodiscard]] int32_t encode_instruction(const InstructionData &instruction, int32_t operand, int32_t position) {
+        // Compute opcode from instruction data.
+        const int32_t opcode = instruction.binary << OPERAND_WIDTH;
+        switch (instruction.operand_mode) {
+            case OperandMode::RELATIVE:
+                operand = operand_low_value(operand - position);
+                break;
+
+            case OperandMode::UPPER:
+                operand = operand_high_value(operand);
+                break;
+
+            case OperandMode::NO_OPERAND:
+                // Enforce discarding of operands. Keeping the value would change the instructions bit-pattern.
+                operand = 0;
+                break;
+
+            default:
+                operand = operand_low_value(operand);
+                break;
+        }
+
+        return opcode | operand;
+    }
 
-        bool contains_start = false, contains_stop = false;
-        int32_t entry_address = -1;
+    [[nodiscard]] std::string discarded_operand_warning(const InstructionData &instruction, int32_t operand,
+                                                        int32_t linenumber) {
+        return "Line " + std::to_string(linenumber) +
+               ": Operand is discarded. Instruction " + instruction.fw_mnemonic +
+               " does not accept an operand, but " + std::to_string(operand) + " is provided.";
+    }
 
-        iterate_section(program.code, [&](const Line &line) {
-            const Instruction &instruction = line.value.instruction;
+    [[nodiscard]] static int32_t translate_line(const Line &line, const SymbolTable &symbol_table,
+                                                std::vector<std::pair<size_t, std::string>> &warnings,
+                                                size_t index) {
+        const InstructionData &instruction = *line.value.instruction.data;
 
-            // Check for duplicate start/stop instructions.
-            if (strcmp(instruction.data->fw_mnemonic, "start") == 0) {
-                if (contains_start) {
-                    throw start_stop_presence("start");
-                }
+        // Compute standalone operand value, later changed depending on variant.
+        const int32_t operand = eval(line.value.instruction.operand, line.base_address, symbol_table);
+        if (instruction.operand_mode == OperandMode::NO_OPERAND && operand != 0) {
+            warnings.emplace_back(index, discarded_operand_warning(instruction, operand, line.linenumber));
+        }
 
-                contains_start = true;
-                entry_address = line.base_address;
+        return encode_instruction(instruction, operand, line.base_address);
+    }
 
-            } else if (strcmp(instruction.data->fw_mnemonic, "stop") == 0) {
-                if (contains_stop) {
-                    throw start_stop_presence("stop");
-                }
+    static void translate_chunk(const Section &code, const SymbolTable &symbol_table,
+                                int32_t *output, TranslatedChunk &chunk) {
+        for (size_t index = chunk.begin; index < chunk.end; index++) {
+            const Line &line = code[index];
+            const int32_t binary = line.value.instruction.data->binary;
 
-                contains_stop = true;
+            if (binary == START_BINARY && chunk.starts.size() < 2) {
+                chunk.starts.push_back(index);
+            } else if (binary == STOP_BINARY && chunk.stops.size() < 2) {
+                chunk.stops.push_back(index);
             }
 
-            // Compute opcode from instruction data.
-            const int32_t opcode = instruction.data->binary << OPERAND_WIDTH;
-            // Compute standalone operand value, later changed depending on variant.
-            int32_t operand = eval(instruction.operand, line.base_address, symbol_table);
-            switch (instruction.data->operand_mode) {
-                case OperandMode::RELATIVE:
-                    operand = operand_low_value(operand - line.base_address);
-                    break;
-
-                case OperandMode::UPPER:
-                    operand = operand_high_value(operand);
-                    break;
-
-                case OperandMode::NO_OPERAND:
-                    if (operand != 0) {
-                        fprintf(stderr,
-                                "[WARNING] Line %d: Operand is discarded. Instruction %s does not accept an operand, but %d is provided.\n",
-                                line.linenumber, instruction.data->fw_mnemonic, operand);
-                        // Enforce discarding of operands. Keeping the value would change the instructions bit-pattern.
-                        operand = 0;
-                    }
-                    break;
-
-                default:
-                    operand = operand_low_value(operand);
-                    break;
+            try {
+                output[index] = translate_line(line, symbol_table, chunk.warnings, index);
+            } catch (error_message &error_message) {
+                error_message.setLineNumber(line.linenumber);
+                chunk.error_index = index;
+                chunk.error = std::current_exception();
+                return;
+            } catch (...) {
+                chunk.error_index = index;
+                chunk.error = std::current_exception();
+                return;
             }
+        }
+    }
 
-            result.push_back(opcode | operand);
-        });
+    [[nodiscard]] static size_t translation_threads(size_t lines) {
+        const size_t available = std::max(1u, std::thread::hardware_concurrency());
+        return std::clamp<size_t>(lines / MINIMUM_LINES_PER_THREAD, 1, available);
+    }
+
+    [[nodiscard]] std::tuple<std::vector<int32_t>, int32_t> translate_program(
+            const Program &program, const SymbolTable &symbol_table) {
+        const Section &code = program.code;
+        std::vector<int32_t> result(code.size());
+
+        // Split code into one chunk per thread. The calling thread translates the first chunk.
+        const size_t thread_count = translation_threads(code.size());
+        std::vector<TranslatedChunk> chunks(thread_count);
+        for (size_t i = 0; i < thread_count; i++) {
+            chunks[i].begin = code.size() * i / thread_count;
+            chunks[i].end = code.size() * (i + 1) / thread_count;
+        }
+
+        std::vector<std::thread> threads;
+        threads.reserve(thread_count - 1);
+        for (size_t i = 1; i < thread_count; i++) {
+            threads.emplace_back(translate_chunk, std::cref(code), std::cref(symbol_table),
+                                 result.data(), std::ref(chunks[i]));
+        }
+        translate_chunk(code, symbol_table, result.data(), chunks[0]);
+        for (auto &thread: threads) {
+            thread.join();
+        }
+
+        // Combine results in line order. A second start or stop instruction is an error at its line.
+        std::vector<size_t> starts, stops;
+        size_t error_index = SIZE_MAX;
+        std::exception_ptr error;
+        for (const auto &chunk: chunks) {
+            starts.insert(starts.end(), chunk.starts.begin(), chunk.starts.end());
+            stops.insert(stops.end(), chunk.stops.begin(), chunk.stops.end());
+            if (chunk.error && error == nullptr) {
+                error_index = chunk.error_index;
+                error = chunk.error;
+            }
+        }
+
+        if (starts.size() > 1 && starts[1] <= error_index && (stops.size() < 2 || starts[1] < stops[1])) {
+            error_index = starts[1];
+            error = std::make_exception_ptr(start_stop_presence("start"));
+        } else if (stops.size() > 1 && stops[1] <= error_index) {
+            error_index = stops[1];
+            error = std::make_exception_ptr(start_stop_presence("stop"));
+        }
+
+        for (const auto &chunk: chunks) {
+            for (const auto &[index, warning]: chunk.warnings) {
+                if (index < error_index) {
+                    fprintf(stderr, "[WARNING] %s\n", warning.c_str());
+                }
+            }
+        }
+
+        if (error) {
+            try {
+                std::rethrow_exception(error);
+            } catch (error_message &error_message) {
+                if (error_index < code.size()) {
+                    error_message.setLineNumber(code[error_index].linenumber);
+                }
+                throw;
+            }
+        }
 
-        if (!contains_start) throw start_stop_presence("start");
-        if (!contains_stop) throw start_stop_presence("stop");
+        if (starts.empty()) throw start_stop_presence("start");
+        if (stops.empty()) throw start_stop_presence("stop");
 
-        return {result, entry_address};
+        return {result, code[starts.front()].base_address};
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+/**
+ * Measurements shared by all benchmarks of the stackmachine-bench executable.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Bench {
+
+    /**
+     * The measured execution times of a workload on an engine.
+     */
+    struct Result {
+        std::string workload;
+        std::string engine;
+        std::vector<std::pair<std::string, int32_t>> parameters;
+        /**
+         * Executions of the workload within a single measurement.
+         */
+        uint64_t repetitions = 1;
+        /**
+         * Executed instructions within a single measurement.
+         */
+        uint64_t instructions = 0;
+        double median_ms = 0;
+        double p99_ms = 0;
+
+        [[nodiscard]] double instructions_per_second() const {
+            return static_cast<double>(instructions) / (median_ms / 1e3);
+        }
+
+        [[nodiscard]] double ns_per_instruction() const {
+            return median_ms * 1e6 / static_cast<double>(instructions);
+        }
+    };
+
+    /**
+     * Computes the median and the 99th percentile of all measurements.
+     */
+    void summarize(std::vector<std::chrono::nanoseconds> times, Result &result);
+
+    /**
+     * Measures every instruction of the machine together with its inverse, executed
+     * forwards and backwards by the reference implementation of the machine.
+     */
+    [[nodiscard]] std::vector<Result> run_instruction_benchmarks(size_t runs, size_t scale);
+}
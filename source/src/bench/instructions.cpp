@@ -0,0 +1,135 @@
+/**
+ * Microbenchmarks for the instructions of the machine.
+ *
+ * For every instruction a straight-line program is generated, which alternates
+ * the instruction with its inverse. The program is executed by VM::step, either
+ * forwards from its first instruction or backwards from its last one. In both
+ * directions the same operations are performed in the same order, so differences
+ * between the directions are caused by decoding and stepping backwards.
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include <string_view>
+#include "bench.h"
+#include "machine/machine.h"
+#include "syntax/instructions.h"
+
+namespace Bench {
+
+    /**
+     * Pairs of an instruction and its inverse in every generated program.
+     */
+    constexpr size_t PROGRAM_PAIRS = 512;
+    /**
+     * Executions of every generated program within a single measurement.
+     */
+    constexpr size_t PROGRAM_REPETITIONS = 1000;
+
+    /**
+     * Values placed on the stack before a program is executed, so every instruction finds its operands.
+     * They are non-zero for division and small enough for shifts to be inverted.
+     */
+    constexpr int32_t STACK_VALUES = 8;
+    constexpr int32_t STACK_VALUE = 3;
+
+    static constexpr int32_t True = Machine::Backward;
+    static constexpr int32_t False = Machine::Forward;
+
+    struct Setup {
+        int32_t operand = 0;
+        int32_t inverse_operand = 0;
+        int32_t top = STACK_VALUE;
+        /**
+         * Instructions skipped at the start of a program, for instructions changing the direction.
+         */
+        int32_t skipped = 0;
+    };
+
+    static Setup setup_for(std::string_view mnemonic) {
+        if (mnemonic == "pushc" || mnemonic == "inc") return {5, 5};
+        if (mnemonic == "allocpar") return {16, 16};
+        if (mnemonic == "asf") return {64, 64};
+        if (mnemonic == "pushl") return {1, 1};
+        if (mnemonic == "xorhc") return {0x1234, 0x1234};
+        // Branches form come-from pairs jumping to each other. Conditional branches are taken.
+        if (mnemonic == "branch") return {1, -1};
+        if (mnemonic == "brt") return {1, -1, True};
+        if (mnemonic == "brf") return {1, -1, False};
+        // Calls do not jump with an offset of 0. Since uncall changes the direction, it alternates
+        // between two instructions instead of executing the whole program, starting with the second one.
+        if (mnemonic == "call") return {0, 0, 0};
+        if (mnemonic == "uncall") return {0, 0, 0, 1};
+        return {};
+    }
+
+    [[nodiscard]] static int32_t encode(int32_t binary, int32_t operand) {
+        return (binary << OPERAND_WIDTH) | operand_low_value(operand);
+    }
+
+    static void prepare_stack(Machine::VM &machine, const Setup &setup) {
+        std::fill(machine.stack.begin(), machine.stack.begin() + STACK_VALUES, STACK_VALUE);
+        machine.stack[STACK_VALUES - 1] = setup.top;
+        machine.sp = STACK_VALUES;
+    }
+
+    /**
+     * Resets all registers for the next execution. Every program restores the stack it started with.
+     */
+    static void prepare_registers(Machine::VM &machine, Machine::Direction dir, int32_t pc) {
+        machine.fp = 0;
+        machine.br = 0;
+        machine.dir = dir;
+        machine.pc = pc;
+    }
+
+    static Result measure(const InstructionData &instruction, Machine::Direction dir, size_t runs, size_t scale) {
+        const Setup setup = setup_for(instruction.fw_mnemonic);
+        std::vector<int32_t> program;
+        for (size_t i = 0; i < PROGRAM_PAIRS; i++) {
+            program.push_back(encode(instruction.binary, setup.operand));
+            program.push_back(encode(INVERSE(instruction.binary), setup.inverse_operand));
+        }
+        const int32_t first = dir == Machine::Forward ? setup.skipped
+                                                      : static_cast<int32_t>(program.size()) - 1 - setup.skipped;
+        const size_t repetitions = PROGRAM_REPETITIONS * scale;
+
+        Machine::VM machine(program, {}, 1024, 1024, first);
+        prepare_stack(machine, setup);
+        std::vector<std::chrono::nanoseconds> times;
+        for (size_t run = 0; run <= runs; run++) {
+            const auto start = std::chrono::steady_clock::now();
+            for (size_t repetition = 0; repetition < repetitions; repetition++) {
+                prepare_registers(machine, dir, first);
+                for (size_t step = 0; step < program.size(); step++) {
+                    machine.step();
+                }
+            }
+            const auto stop = std::chrono::steady_clock::now();
+            if (run > 0) times.push_back(stop - start); // The first run warms up caches.
+        }
+
+        Result result;
+        result.workload = std::string(instruction.fw_mnemonic) + "/" + instruction.bw_mnemonic;
+        result.engine = dir == Machine::Forward ? "step-forward" : "step-backward";
+        result.parameters = {{"operand", setup.operand}};
+        result.repetitions = repetitions;
+        result.instructions = repetitions * program.size();
+        summarize(std::move(times), result);
+        return result;
+    }
+
+    std::vector<Result> run_instruction_benchmarks(size_t runs, size_t scale) {
+        std::vector<Result> results;
+        for (const InstructionData &instruction: KNOWN_INSTRUCTIONS) {
+            try {
+                results.push_back(measure(instruction, Machine::Forward, runs, scale));
+                results.push_back(measure(instruction, Machine::Backward, runs, scale));
+            } catch (std::exception &exception) {
+                throw std::runtime_error("Benchmark of " + std::string(instruction.fw_mnemonic) + " failed: " +
+                                         exception.what());
+            }
+        }
+        return results;
+    }
+}
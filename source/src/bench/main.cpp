@@ -0,0 +1,464 @@
+/**
+ * Program entry point for an auxiliary executable, that benchmarks the
+ * virtual machine on a fixed set of example programs.
+ *
+ * Every workload is executed several times on every engine. The median and
+ * 99th percentile of the execution times are reported together with the
+ * throughput in JSON. If a baseline report is given, results are compared
+ * against it and the benchmark fails if any workload became slower than
+ * the configured threshold allows.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "assembler/assembler.h"
+#include "bench.h"
+#include "json/json.h"
+#include "machine/machine.h"
+#include "messages/error.h"
+#include "optimizer/optimizer.h"
+#include "syntax/syntax.h"
+
+using std::cout, std::cerr, std::endl;
+using Bench::Result;
+
+#ifndef STACKMACHINE_EXAMPLES_DIR
+#define STACKMACHINE_EXAMPLES_DIR "examples"
+#endif
+#ifndef STACKMACHINE_BUILD_TYPE
+#define STACKMACHINE_BUILD_TYPE ""
+#endif
+
+static const char *help_page =
+        "Supported options are:\n"
+        " -h, --help\n"
+        "    Print this help page and exit.\n"
+        " -r, --runs [N]\n"
+        "    Measure every workload N times (default 7). Small workloads are executed\n"
+        "    repeatedly within a single measurement.\n"
+        " --scale [N]\n"
+        "    Multiply the size of every workload by N (default 1).\n"
+        " -w, --workload [NAME]\n"
+        "    Only run the named workload. May be given multiple times.\n"
+        " -e, --engine [NAME]\n"
+        "    Only use the named engine, which is either run or step.\n"
+        " -o, --output [FILE]\n"
+        "    Write the JSON report to FILE instead of standard output.\n"
+        " -b, --baseline [FILE]\n"
+        "    Compare the results against the report stored in FILE. If FILE does not\n"
+        "    exist, the current report is stored there instead.\n"
+        " -t, --threshold [PERCENT]\n"
+        "    Fail if the time per instruction of any workload exceeds the baseline\n"
+        "    by more than PERCENT (default 10).\n"
+        " -i, --instructions\n"
+        "    Measure every instruction of the machine together with its inverse\n"
+        "    instead of the workloads, executed forwards and backwards by the\n"
+        "    step engine. Every instruction is reported twice, for the engines\n"
+        "    step-forward and step-backward.\n"
+        " --examples [DIR]\n"
+        "    Read the example programs from DIR.\n"
+        "\n"
+        "The run engine executes programs like the stackmachine executable does.\n"
+        "The step engine executes every instruction using the reference implementation,\n"
+        "as done by the debugger and all instrumented executions.\n"
+        "\n"
+        "The exit code is 1 if a regression was detected or a workload failed, and 2\n"
+        "for invalid arguments.";
+
+
+enum class Engine {
+    RUN, STEP
+};
+
+static const char *engine_name(Engine engine) {
+    return engine == Engine::RUN ? "run" : "step";
+}
+
+struct Workload {
+    std::string name;
+    std::string file;
+    std::vector<Optimizer::ConstantOverride> overrides;
+    size_t memory_size = 102400;
+    size_t stack_size = 1024;
+    /**
+     * Executions of the program within a single measurement.
+     */
+    size_t repetitions = 1;
+};
+
+/**
+ * Returns the smallest n with log10(n!) >= digits, which is the amount of terms
+ * euler.rsc requires to compute the given amount of digits.
+ */
+static int32_t euler_terms(int32_t digits) {
+    int32_t terms = 1;
+    while (std::lgamma(terms + 1.0) / std::log(10.0) < digits) {
+        terms++;
+    }
+    return terms;
+}
+
+static std::vector<Workload> create_workloads(const std::string &examples, size_t scale) {
+    const auto path = [&](const char *file) {
+        return (std::filesystem::path(examples) / file).string();
+    };
+    const auto scaled = [&](size_t value) {
+        return value * scale;
+    };
+
+    std::vector<Workload> workloads;
+
+    // The print loop of euler.rsc expects 5000 digits, so only a single digit is printed for other amounts.
+    const auto digits = static_cast<int32_t>(std::min<size_t>(scaled(250), 4999));
+    const int32_t terms = euler_terms(digits);
+    workloads.push_back({"euler", path("euler.rsc"),
+                         {{"how_many_digits", digits}, {"aux_number", terms}, {"print_count", 5000 - digits}},
+                         2 * static_cast<size_t>(digits) * terms + 65536, 10240, 1});
+
+    // Small workloads are repeated and get only as much memory as they need, so creating machines stays cheap.
+    workloads.push_back({"collatz", path("collatz.rsc"), {{"input", 27}}, 1024, 1024, scaled(1000)});
+    workloads.push_back({"factorial", path("factorial.rsc"), {{"input", 12}}, 1024, 1024, scaled(10000)});
+    workloads.push_back({"polymorph", path("polymorph.rsc"), {}, 1024, 1024, scaled(3000)});
+    workloads.push_back({"sum-memory", path("sum-memory.rsc"), {}, 1024, 1024, scaled(5000)});
+    return workloads;
+}
+
+struct Assembled {
+    Assembler::MemoryLayout memory;
+    std::vector<int32_t> code;
+    int32_t entry_address;
+};
+
+static Assembled assemble_workload(Workload &workload) {
+    Program program = parse_file(workload.file);
+    Optimizer::override_constants(program, workload.overrides);
+    for (const auto &override: workload.overrides) {
+        if (!override.is_applied) {
+            throw undefined_constant(override.symbol);
+        }
+    }
+
+    Assembled assembled;
+    std::tie(assembled.memory, assembled.code, assembled.entry_address) = Assembler::assemble(program);
+    return assembled;
+}
+
+/**
+ * Executes a workload once and returns the time spent executing it, excluding the creation of the machine.
+ */
+static std::chrono::nanoseconds execute(const Workload &workload, const Assembled &program, Engine engine,
+                                        uint64_t &instructions) {
+    Machine::VM machine(program.code, program.memory, workload.memory_size, workload.stack_size,
+                        program.entry_address);
+
+    const auto start = std::chrono::steady_clock::now();
+    if (engine == Engine::RUN) {
+        machine.run();
+    } else {
+        do {
+            machine.step();
+        } while (machine.running);
+    }
+    const auto stop = std::chrono::steady_clock::now();
+
+    instructions = machine.counter;
+    return stop - start;
+}
+
+static Result measure(const Workload &workload, const Assembled &program, Engine engine, size_t runs) {
+    uint64_t instructions = 0;
+    (void) execute(workload, program, engine, instructions); // Warm up caches and the allocator.
+
+    std::vector<std::chrono::nanoseconds> times;
+    for (size_t run = 0; run < runs; run++) {
+        std::chrono::nanoseconds total{0};
+        for (size_t repetition = 0; repetition < workload.repetitions; repetition++) {
+            total += execute(workload, program, engine, instructions);
+        }
+        times.push_back(total);
+    }
+
+    Result result;
+    result.workload = workload.name;
+    result.engine = engine_name(engine);
+    for (const auto &override: workload.overrides) {
+        result.parameters.emplace_back(override.symbol, override.value);
+    }
+    result.repetitions = workload.repetitions;
+    result.instructions = instructions * workload.repetitions;
+    Bench::summarize(std::move(times), result);
+    return result;
+}
+
+namespace Bench {
+    void summarize(std::vector<std::chrono::nanoseconds> times, Result &result) {
+        const auto milliseconds = [](std::chrono::nanoseconds time) {
+            return std::chrono::duration<double, std::milli>(time).count();
+        };
+        std::sort(times.begin(), times.end());
+
+        const size_t middle = times.size() / 2;
+        result.median_ms = times.size() % 2 == 1 ? milliseconds(times[middle])
+                                                 : (milliseconds(times[middle - 1]) + milliseconds(times[middle])) / 2;
+        // Nearest rank percentile.
+        const auto p99_rank = static_cast<size_t>(std::ceil(0.99 * static_cast<double>(times.size())));
+        result.p99_ms = milliseconds(times[std::max<size_t>(p99_rank, 1) - 1]);
+    }
+}
+
+static void print_result(const Result &result) {
+    cerr << std::left << std::setw(20) << result.workload << std::setw(14) << result.engine
+         << std::right << std::fixed << std::setprecision(2)
+         << " median " << std::setw(9) << result.median_ms << "ms"
+         << "  p99 " << std::setw(9) << result.p99_ms << "ms  "
+         << std::setw(7) << result.instructions_per_second() / 1e6 << "M instr/s  "
+         << std::setw(6) << result.ns_per_instruction() << " ns/instr" << endl;
+}
+
+static std::vector<Result> run_workloads(std::vector<Workload> &workloads,
+                                         const std::vector<std::string> &selected_workloads,
+                                         std::optional<Engine> selected_engine, size_t runs) {
+    std::vector<Result> results;
+    for (Workload &workload: workloads) {
+        if (!selected_workloads.empty() &&
+            std::find(selected_workloads.begin(), selected_workloads.end(), workload.name) ==
+            selected_workloads.end()) {
+            continue;
+        }
+
+        const Assembled program = assemble_workload(workload);
+        for (const Engine engine: {Engine::RUN, Engine::STEP}) {
+            if (selected_engine.has_value() && selected_engine.value() != engine) continue;
+            results.push_back(measure(workload, program, engine, runs));
+            print_result(results.back());
+        }
+    }
+    return results;
+}
+
+static bool is_unsafe_build() {
+#ifdef UNSAFE_OPERATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+static void write_report(std::ostream &output, const std::vector<Result> &results, size_t runs, size_t scale) {
+    Json::Writer json(output);
+    json.begin_object();
+    json.key("build").begin_object()
+            .member("type", STACKMACHINE_BUILD_TYPE)
+            .member("unsafe_operations", is_unsafe_build())
+            .end_object();
+    json.member("runs", static_cast<uint64_t>(runs));
+    json.member("scale", static_cast<uint64_t>(scale));
+
+    json.key("results").begin_array();
+    for (const Result &result: results) {
+        json.begin_object();
+        json.member("workload", result.workload);
+        json.member("engine", result.engine);
+        json.key("parameters").begin_object();
+        for (const auto &[name, value]: result.parameters) {
+            json.member(name, value);
+        }
+        json.end_object();
+        json.member("repetitions", result.repetitions);
+        json.member("instructions", result.instructions);
+        json.member("median_ms", result.median_ms);
+        json.member("p99_ms", result.p99_ms);
+        json.member("instructions_per_second", result.instructions_per_second());
+        json.member("ns_per_instruction", result.ns_per_instruction());
+        json.end_object();
+    }
+    json.end_array();
+    json.end_object();
+}
+
+static void print_asymmetry(const Result &forward, const Result &backward) {
+    const double change = (backward.ns_per_instruction() / forward.ns_per_instruction() - 1) * 100;
+    cerr << std::left << std::setw(20) << forward.workload << std::right << std::fixed << std::setprecision(2)
+         << " forward " << std::setw(6) << forward.ns_per_instruction() << " ns/instr"
+         << "  backward " << std::setw(6) << backward.ns_per_instruction() << " ns/instr ("
+         << std::showpos << change << "%" << std::noshowpos << ")" << endl;
+}
+
+static std::string string_member(const Json::Value &object, const char *key) {
+    const Json::Value *member = object.find(key);
+    return member != nullptr && member->kind == Json::Value::STRING ? member->string : "";
+}
+
+static double number_member(const Json::Value &object, const char *key) {
+    const Json::Value *member = object.find(key);
+    return member != nullptr && member->kind == Json::Value::NUMBER ? member->number : 0;
+}
+
+/**
+ * Compares results against a baseline report and returns the number of regressions.
+ */
+static size_t compare_with_baseline(const std::vector<Result> &results, const Json::Value &baseline,
+                                    double threshold) {
+    const Json::Value *build = baseline.find("build");
+    if (build == nullptr || string_member(*build, "type") != STACKMACHINE_BUILD_TYPE ||
+        build->find("unsafe_operations") == nullptr ||
+        build->find("unsafe_operations")->boolean != is_unsafe_build()) {
+        cerr << "[WARNING] Baseline was recorded with a different build configuration." << endl;
+    }
+
+    const Json::Value *baseline_results = baseline.find("results");
+    if (baseline_results == nullptr || baseline_results->kind != Json::Value::ARRAY) {
+        throw std::invalid_argument("Baseline does not contain any results.");
+    }
+
+    size_t regressions = 0;
+    for (const Result &result: results) {
+        const auto previous = std::find_if(
+                baseline_results->elements.begin(), baseline_results->elements.end(), [&](const Json::Value &entry) {
+                    return string_member(entry, "workload") == result.workload &&
+                           string_member(entry, "engine") == result.engine;
+                });
+        if (previous == baseline_results->elements.end()) continue;
+
+        cerr << std::left << std::setw(20) << result.workload << std::setw(14) << result.engine << std::right;
+        if (number_member(*previous, "instructions") != static_cast<double>(result.instructions)) {
+            cerr << " not comparable, the baseline executed a different amount of instructions." << endl;
+            continue;
+        }
+
+        const double before = number_member(*previous, "ns_per_instruction");
+        const double change = (result.ns_per_instruction() / before - 1) * 100;
+        const bool is_regression = change > threshold;
+        cerr << std::fixed << std::setprecision(2) << " " << std::setw(6) << before << " -> "
+             << std::setw(6) << result.ns_per_instruction() << " ns/instr (" << std::showpos << change << "%"
+             << std::noshowpos << ")" << (is_regression ? "  REGRESSION" : "") << endl;
+        if (is_regression) regressions++;
+    }
+    return regressions;
+}
+
+static bool parse_number(const char *arg, size_t &result) {
+    char *end;
+    const unsigned long long value = strtoull(arg, &end, 10);
+    result = static_cast<size_t>(value);
+    return *arg != '\0' && *end == '\0';
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<std::string> selected_workloads;
+    std::optional<Engine> selected_engine;
+    const char *output_file = nullptr, *baseline_file = nullptr;
+    std::string examples = STACKMACHINE_EXAMPLES_DIR;
+    size_t runs = 7, scale = 1, threshold = 10;
+    bool should_measure_instructions = false;
+
+    for (int i = 1; i < argc; i++) {
+        const bool has_argument = i + 1 < argc;
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            cout << "Benchmarks the virtual machine of the reversible stack machine.\n\n";
+            cout << "  " << argv[0] << " [OPTIONS]\n\n";
+            cout << help_page << endl;
+            return 0;
+        } else if (has_argument && (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--runs") == 0)) {
+            if (!parse_number(argv[++i], runs) || runs == 0) {
+                cerr << "Invalid amount of runs: " << argv[i] << endl;
+                return 2;
+            }
+        } else if (has_argument && strcmp(argv[i], "--scale") == 0) {
+            if (!parse_number(argv[++i], scale) || scale == 0) {
+                cerr << "Invalid scale: " << argv[i] << endl;
+                return 2;
+            }
+        } else if (has_argument && (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--threshold") == 0)) {
+            if (!parse_number(argv[++i], threshold)) {
+                cerr << "Invalid threshold: " << argv[i] << endl;
+                return 2;
+            }
+        } else if (has_argument && (strcmp(argv[i], "-w") == 0 || strcmp(argv[i], "--workload") == 0)) {
+            selected_workloads.emplace_back(argv[++i]);
+        } else if (has_argument && (strcmp(argv[i], "-e") == 0 || strcmp(argv[i], "--engine") == 0)) {
+            i++;
+            if (strcmp(argv[i], "run") == 0) selected_engine = Engine::RUN;
+            else if (strcmp(argv[i], "step") == 0) selected_engine = Engine::STEP;
+            else {
+                cerr << "Unknown engine: " << argv[i] << endl;
+                return 2;
+            }
+        } else if (has_argument && (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0)) {
+            output_file = argv[++i];
+        } else if (has_argument && (strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "--baseline") == 0)) {
+            baseline_file = argv[++i];
+        } else if (strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "--instructions") == 0) {
+            should_measure_instructions = true;
+        } else if (has_argument && strcmp(argv[i], "--examples") == 0) {
+            examples = argv[++i];
+        } else {
+            cerr << "Unexpected argument: " << argv[i] << ". See --help for usage." << endl;
+            return 2;
+        }
+    }
+
+    try {
+        std::vector<Workload> workloads = create_workloads(examples, scale);
+        for (const std::string &name: selected_workloads) {
+            if (std::none_of(workloads.begin(), workloads.end(), [&](const Workload &w) { return w.name == name; })) {
+                cerr << "Unknown workload: " << name << endl;
+                return 2;
+            }
+        }
+
+        std::vector<Result> results;
+        if (should_measure_instructions) {
+            results = Bench::run_instruction_benchmarks(runs, scale);
+            for (size_t i = 0; i + 1 < results.size(); i += 2) {
+                print_asymmetry(results[i], results[i + 1]);
+            }
+        } else {
+            results = run_workloads(workloads, selected_workloads, selected_engine, runs);
+        }
+
+        if (output_file != nullptr) {
+            std::ofstream output(output_file);
+            if (!output) {
+                throw std::invalid_argument("File " + std::string(output_file) + " cannot be opened for writing.");
+            }
+            write_report(output, results, runs, scale);
+        } else {
+            write_report(cout, results, runs, scale);
+        }
+
+        if (baseline_file != nullptr) {
+            if (!std::filesystem::exists(baseline_file)) {
+                std::ofstream baseline(baseline_file);
+                if (!baseline) {
+                    throw std::invalid_argument("File " + std::string(baseline_file) + " cannot be opened for writing.");
+                }
+                write_report(baseline, results, runs, scale);
+                cerr << "No baseline found. Stored results as baseline in " << baseline_file << "." << endl;
+                return 0;
+            }
+
+            const size_t regressions = compare_with_baseline(results, Json::read_file(baseline_file),
+                                                             static_cast<double>(threshold));
+            if (regressions > 0) {
+                cerr << regressions << " workload(s) regressed by more than " << threshold << "%." << endl;
+                return 1;
+            }
+        }
+        return 0;
+
+    } catch (std::exception &exception) {
+        cerr << "[ERROR] " << exception.what() << endl;
+        return 1;
+    }
+}
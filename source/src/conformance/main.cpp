@@ -0,0 +1,338 @@
+/**
+ * Program entry point for an auxiliary executable, that checks the virtual
+ * machine against the expected results of test programs.
+ *
+ * Every program is executed on every engine of the machine. The final stack
+ * must match the expected result and all engines must reach the same machine
+ * state. Afterwards, every program is executed backwards from its final state,
+ * which must restore the initial state of the machine.
+ *
+ * Programs are parsed and assembled one after another, since the parser is not
+ * reentrant. They are executed in parallel afterwards.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include "assembler/assembler.h"
+#include "json/json.h"
+#include "machine/machine.h"
+#include "optimizer/optimizer.h"
+#include "syntax/syntax.h"
+
+using std::cout, std::cerr, std::endl;
+
+static const char *help_page =
+        "Supported options are:\n"
+        " -h, --help\n"
+        "    Print this help page and exit.\n"
+        " -j, --jobs [N]\n"
+        "    Execute programs on N threads (default: one per processor).\n"
+        " -v, --verbose\n"
+        "    Print the outcome of every program, not only of failed ones.\n"
+        " -O, --optimize\n"
+        "    Remove instructions without effect from every program before it is\n"
+        "    assembled, like stackmachine -O does.\n"
+        " -O2\n"
+        "    Like -O, but additionally inline small procedures.\n"
+        " -x, --exclude [NAME]\n"
+        "    Skip the program with the file name NAME. May be given multiple times,\n"
+        "    for example to skip programs depending on code distances when optimizing.\n"
+        "\n"
+        "If DIR is given, every program listed in DIR/expected.json is executed and its\n"
+        "final stack is compared with the expected one. Every other PROGRAM is only\n"
+        "compared across engines and directions.\n"
+        "\n"
+        "The exit code is 1 if any program failed and 2 for invalid arguments.";
+
+enum class Engine {
+    RUN, STEP
+};
+
+static const char *engine_name(Engine engine) {
+    return engine == Engine::RUN ? "run" : "step";
+}
+
+
+struct TestProgram {
+    std::string file;
+    /**
+     * The expected stack, listed from its top to its bottom.
+     */
+    std::optional<std::vector<int32_t>> expected;
+    size_t stack_size = 1024;
+    size_t memory_size = 102400;
+
+    Assembler::MemoryLayout memory;
+    std::vector<int32_t> code;
+    int32_t entry_address = 0;
+    std::string load_error;
+
+    std::vector<std::string> failures;
+};
+
+/**
+ * The machine state after execution, compared across engines.
+ */
+struct State {
+    Machine::Direction dir;
+    int32_t pc, br, sp, fp;
+    bool running;
+    size_t counter;
+    std::vector<int32_t> stack; // Up to sp.
+    std::vector<int32_t> memory;
+    std::string error;
+
+    State(const Machine::VM &machine, std::string error) :
+            dir(machine.dir), pc(machine.pc), br(machine.br), sp(machine.sp), fp(machine.fp),
+            running(machine.running), counter(machine.counter),
+            stack(machine.stack.begin(), machine.stack.begin() + std::clamp<int32_t>(machine.sp, 0, machine.stack.size())),
+            memory(machine.memory), error(std::move(error)) {}
+
+    bool operator==(const State &other) const = default;
+};
+
+static void execute(Machine::VM &machine, Engine engine) {
+    if (engine == Engine::RUN) {
+        machine.run();
+    } else {
+        do {
+            machine.step();
+        } while (machine.running);
+    }
+}
+
+static std::optional<std::string> execute_safely(Machine::VM &machine, Engine engine) {
+    try {
+        execute(machine, engine);
+        return std::nullopt;
+    } catch (std::exception &exception) {
+        return exception.what();
+    }
+}
+
+/**
+ * Describes how a state differs from the expected one, naming the first difference.
+ */
+static std::string describe_difference(const State &expected, const State &actual) {
+    std::stringstream description;
+    if (expected.error != actual.error) {
+        description << "error '" << actual.error << "' instead of '" << expected.error << "'";
+    } else if (expected.counter != actual.counter) {
+        description << "instruction counter " << actual.counter << " instead of " << expected.counter;
+    } else if (expected.pc != actual.pc || expected.dir != actual.dir || expected.br != actual.br) {
+        description << "pc " << actual.pc << " (dir " << actual.dir << ", br " << actual.br << ") instead of "
+                    << expected.pc << " (dir " << expected.dir << ", br " << expected.br << ")";
+    } else if (expected.sp != actual.sp || expected.fp != actual.fp || expected.running != actual.running) {
+        description << "sp " << actual.sp << ", fp " << actual.fp << " instead of sp " << expected.sp
+                    << ", fp " << expected.fp;
+    } else if (expected.stack != actual.stack) {
+        const auto [first, _] = std::mismatch(expected.stack.begin(), expected.stack.end(), actual.stack.begin());
+        description << "value at stack address " << (first - expected.stack.begin());
+    } else {
+        const auto [first, _] = std::mismatch(expected.memory.begin(), expected.memory.end(), actual.memory.begin());
+        description << "value at memory address " << (first - expected.memory.begin());
+    }
+    return description.str();
+}
+
+static std::string format_stack(const std::vector<int32_t> &values) {
+    std::stringstream result;
+    result << "[";
+    for (size_t i = 0; i < values.size(); i++) {
+        result << (i == 0 ? "" : ", ") << values[i];
+    }
+    result << "]";
+    return result.str();
+}
+
+/**
+ * Executes the program backwards from its final state, which must lead to the initial state.
+ */
+static void check_reversal(TestProgram &test, Machine::VM &machine, Engine engine) {
+    const Machine::Direction dir = machine.dir;
+    machine.dir = !dir;
+    machine.pc -= dir; // Last executed instruction, which stopped the machine.
+
+    const auto error = execute_safely(machine, engine);
+    const std::string prefix = std::string("backwards on ") + engine_name(engine) + ": ";
+    if (error.has_value()) {
+        test.failures.push_back(prefix + error.value());
+        return;
+    }
+
+    Machine::VM initial(test.code, test.memory, test.memory_size, test.stack_size, test.entry_address);
+    if (machine.sp != 0 || machine.fp != 0 || machine.br != 0 || machine.pc != test.entry_address - 1) {
+        test.failures.push_back(prefix + "stopped at pc " + std::to_string(machine.pc) + " with sp " +
+                                std::to_string(machine.sp) + ", fp " + std::to_string(machine.fp) + " and br " +
+                                std::to_string(machine.br) + " instead of restoring the initial state");
+    } else if (machine.memory != initial.memory) {
+        test.failures.push_back(prefix + "memory differs from the initial memory");
+    }
+}
+
+static void check_program(TestProgram &test) {
+    if (!test.load_error.empty()) {
+        test.failures.push_back(test.load_error);
+        return;
+    }
+
+    std::optional<State> reference;
+    for (const Engine engine: {Engine::STEP, Engine::RUN}) {
+        Machine::VM machine(test.code, test.memory, test.memory_size, test.stack_size, test.entry_address);
+        const auto error = execute_safely(machine, engine);
+        const State state(machine, error.value_or(""));
+
+        if (!reference.has_value()) {
+            reference = state;
+            std::vector<int32_t> result(state.stack.rbegin(), state.stack.rend());
+            if (error.has_value()) {
+                test.failures.push_back(std::string("failed on ") + engine_name(engine) + ": " + error.value());
+            } else if (test.expected.has_value() && result != test.expected.value()) {
+                test.failures.push_back("expected " + format_stack(test.expected.value()) + " but got " +
+                                        format_stack(result));
+            }
+        } else if (state != reference.value()) {
+            test.failures.push_back(std::string("engine ") + engine_name(engine) + " differs from step in " +
+                                    describe_difference(reference.value(), state));
+        }
+
+        if (!error.has_value()) {
+            check_reversal(test, machine, engine);
+        }
+    }
+}
+
+static void load_program(TestProgram &test, unsigned optimization_level) {
+    try {
+        Program program = parse_file(test.file);
+        if (optimization_level >= 2) (void) Optimizer::inline_procedures(program);
+        if (optimization_level >= 1) (void) Optimizer::eliminate_redundant_instructions(program);
+        std::tie(test.memory, test.code, test.entry_address) = Assembler::assemble(program);
+    } catch (std::exception &exception) {
+        test.load_error = std::string("cannot be loaded: ") + exception.what();
+    }
+}
+
+static std::vector<TestProgram> read_expectations(const std::filesystem::path &directory) {
+    const Json::Value expected = Json::read_file((directory / "expected.json").string());
+    if (expected.kind != Json::Value::ARRAY) {
+        throw std::invalid_argument("Expected results must be given as list.");
+    }
+
+    std::vector<TestProgram> tests;
+    for (const Json::Value &entry: expected.elements) {
+        const Json::Value *file = entry.find("file"), *result = entry.find("result");
+        if (file == nullptr || file->kind != Json::Value::STRING || result == nullptr ||
+            result->kind != Json::Value::ARRAY) {
+            throw std::invalid_argument("Expected results must list a file and a resulting stack.");
+        }
+
+        TestProgram &test = tests.emplace_back();
+        test.file = (directory / file->string).string();
+        test.expected.emplace();
+        if (const Json::Value *size = entry.find("stacksize"); size != nullptr) {
+            test.stack_size = static_cast<size_t>(size->number);
+        }
+        if (const Json::Value *size = entry.find("memorysize"); size != nullptr) {
+            test.memory_size = static_cast<size_t>(size->number);
+        }
+        for (const Json::Value &value: result->elements) {
+            test.expected->push_back(static_cast<int32_t>(value.number));
+        }
+    }
+    return tests;
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<TestProgram> tests;
+    std::vector<std::string> directories, excluded;
+    unsigned optimization_level = 0;
+    size_t jobs = std::max(1u, std::thread::hardware_concurrency());
+    bool is_verbose = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            cout << "Checks the reversible stack machine against test programs.\n\n";
+            cout << "  " << argv[0] << " [OPTIONS] [DIR] [PROGRAM...]\n\n";
+            cout << help_page << endl;
+            return 0;
+        } else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--verbose") == 0) {
+            is_verbose = true;
+        } else if (strcmp(argv[i], "-O") == 0 || strcmp(argv[i], "--optimize") == 0) {
+            optimization_level = 1;
+        } else if (strcmp(argv[i], "-O2") == 0) {
+            optimization_level = 2;
+        } else if (i + 1 < argc && (strcmp(argv[i], "-x") == 0 || strcmp(argv[i], "--exclude") == 0)) {
+            excluded.emplace_back(argv[++i]);
+        } else if (i + 1 < argc && (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--jobs") == 0)) {
+            jobs = strtoul(argv[++i], nullptr, 10);
+            if (jobs == 0) {
+                cerr << "Invalid amount of jobs: " << argv[i] << endl;
+                return 2;
+            }
+        } else if (std::filesystem::is_directory(argv[i])) {
+            directories.emplace_back(argv[i]);
+        } else {
+            tests.emplace_back().file = argv[i];
+        }
+    }
+    if (tests.empty() && directories.empty()) {
+        cerr << "Missing test directory or programs. See --help for usage." << endl;
+        return 2;
+    }
+
+    try {
+        for (const std::string &directory: directories) {
+            std::vector<TestProgram> listed = read_expectations(directory);
+            std::move(listed.begin(), listed.end(), std::back_inserter(tests));
+        }
+        std::erase_if(tests, [&](const TestProgram &test) {
+            const std::string name = std::filesystem::path(test.file).filename().string();
+            return std::find(excluded.begin(), excluded.end(), name) != excluded.end();
+        });
+        for (TestProgram &test: tests) {
+            load_program(test, optimization_level);
+        }
+
+        std::atomic<size_t> next_test = 0;
+        const auto check_programs = [&]() {
+            for (size_t index = next_test++; index < tests.size(); index = next_test++) {
+                check_program(tests[index]);
+            }
+        };
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < std::min(jobs, tests.size()); i++) {
+            threads.emplace_back(check_programs);
+        }
+        check_programs();
+        for (std::thread &thread: threads) {
+            thread.join();
+        }
+
+        size_t failed = 0;
+        for (const TestProgram &test: tests) {
+            if (!test.failures.empty()) failed++;
+            if (is_verbose || !test.failures.empty()) {
+                cout << (test.failures.empty() ? "PASS " : "FAIL ") << test.file << "\n";
+            }
+            for (const std::string &failure: test.failures) {
+                cout << "     " << failure << "\n";
+            }
+        }
+        cout << (tests.size() - failed) << " of " << tests.size() << " programs passed." << endl;
+        return failed == 0 ? 0 : 1;
+
+    } catch (std::exception &exception) {
+        cerr << "[ERROR] " << exception.what() << endl;
+        return 1;
+    }
+}
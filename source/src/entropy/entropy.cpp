@@ -23,13 +23,19 @@ namespace Entropy {
     static unsigned long long count_entropy(const Assembler::MemoryLayout &original_memory,
                                             const Machine::VM &machine) {
         unsigned long long result = 0;
-        // Compare values in memory.
-        for (int32_t address = 0; (unsigned) address < machine.memory.size(); address++) {
-            if (original_memory.contains(address)) {
-                result += entropy_generated_with_words(machine.memory[address], original_memory.at(address));
-            } else {
+        // Compare values in memory, walking the segments of the original image in address order.
+        size_t address = 0;
+        for (const auto &segment: original_memory.segments()) {
+            for (; address < (size_t) segment.base_address; address++) {
                 result += entropy_generated_with_words(machine.memory[address], 0);
             }
+            const int32_t *original_words = original_memory.data(segment);
+            for (size_t offset = 0; offset < segment.size; offset++, address++) {
+                result += entropy_generated_with_words(machine.memory[address], original_words[offset]);
+            }
+        }
+        for (; address < machine.memory.size(); address++) {
+            result += entropy_generated_with_words(machine.memory[address], 0);
         }
         // Compare values on stack.
         for (int32_t stack_address = 0; stack_address < machine.sp; stack_address++) {
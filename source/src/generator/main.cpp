@@ -0,0 +1,373 @@
+/**
+ * Program entry point for an auxiliary executable, that generates synthetic
+ * programs of arbitrary size for stress and throughput testing.
+ *
+ * Every generated program is reversible and comes with its expected final
+ * stack. The programs are written into a directory together with an
+ * expected.json, which can be checked by stackmachine-conformance.
+ */
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "json/json.h"
+
+using std::cout, std::cerr, std::endl;
+
+static const char *help_page =
+        "Supported options are:\n"
+        " -h, --help\n"
+        "    Print this help page and exit.\n"
+        " -o, --output [DIR]\n"
+        "    Write programs and their expected results into DIR (default: .).\n"
+        " --seed [N]\n"
+        "    Seed for random choices made while generating programs (default: 0).\n"
+        "\n"
+        "Every SHAPE generates a program of the given SIZE (default: 1000):\n"
+        " calls\n"
+        "    A chain of SIZE procedures, each calling or uncalling the next one.\n"
+        " arithmetic\n"
+        "    SIZE straight-line arithmetic instructions on two values.\n"
+        " memory\n"
+        "    SIZE words in a .word section, moved into a .bss section by a loop.\n"
+        " labels\n"
+        "    SIZE labelled instructions, referencing other labels and constants.\n"
+        "\n"
+        "The programs are listed in DIR/expected.json together with their expected\n"
+        "final stack and the stack and memory sizes required to execute them.";
+
+struct GeneratedProgram {
+    std::string source;
+    /**
+     * The expected stack, listed from its top to its bottom.
+     */
+    std::vector<int32_t> result;
+    size_t stack_size = 1024;
+    size_t memory_size = 102400;
+};
+
+using Random = std::mt19937_64;
+
+static int32_t random_between(Random &random, int32_t min, int32_t max) {
+    return std::uniform_int_distribution<int32_t>(min, max)(random);
+}
+
+/**
+ * Pushes a constant, which may exceed the operand of pushc. Its upper bits are added by xorhc.
+ */
+static void push_wide(std::ostream &source, const std::string &constant) {
+    source << "        pushc " << constant << "\n";
+    source << "        xorhc " << constant << "\n";
+}
+
+/**
+ * Pops a constant, which may exceed the operand of popc. Inverse to push_wide.
+ */
+static void pop_wide(std::ostream &source, const std::string &constant) {
+    source << "        xorhc " << constant << "\n";
+    source << "        popc " << constant << "\n";
+}
+
+/**
+ * Generates procedures proc_1 to proc_SIZE, where every procedure increments its argument
+ * and passes it to the next procedure. The next procedure is either called or uncalled, in
+ * which case it is executed backwards and decrements the argument instead.
+ */
+static GeneratedProgram generate_calls(size_t size, Random &random) {
+    std::vector<int32_t> increments(size + 1);
+    std::vector<bool> is_uncalled(size + 1);
+    for (size_t i = 1; i <= size; i++) {
+        increments[i] = random_between(random, 1, 100);
+        is_uncalled[i] = random_between(random, 0, 1) == 1;
+    }
+
+    std::stringstream source;
+    const auto emit_call = [&](size_t caller, size_t callee) {
+        const std::string label = "call_" + std::to_string(caller), target = "proc_" + std::to_string(callee);
+        source << "        pushc [" << target << " - " << label << "]\n";
+        source << label << ": " << (is_uncalled[callee] ? "uncall" : "call") << "\n";
+        source << "        popc [" << label << " - " << target << "]\n";
+    };
+
+    const int32_t input = random_between(random, -1000, 1000);
+    source << "        start\n";
+    source << "        pushc " << input << "\n";
+    emit_call(0, 1);
+    source << "        stop\n";
+
+    // The effect of procedure i on its argument, including all procedures it calls.
+    int64_t effect = 0;
+    for (size_t i = size; i >= 1; i--) {
+        effect = increments[i] + (i < size && is_uncalled[i + 1] ? -effect : effect);
+    }
+    for (size_t i = 1; i <= size; i++) {
+        const std::string name = "proc_" + std::to_string(i);
+        source << "\n" << name << "_top: branch " << name << "_bot\n";
+        source << name << ": call\n";
+        source << "        neg\n";
+        source << "        asf 0\n";
+        source << "        pushl -2\n";
+        source << "        inc " << increments[i] << "\n";
+        if (i < size) emit_call(i, i + 1);
+        source << "        popl -2\n";
+        source << "        rsf 0\n";
+        source << name << "_bot: branch " << name << "_top\n";
+    }
+
+    GeneratedProgram program;
+    program.source = source.str();
+    program.result = {static_cast<int32_t>(input + (is_uncalled[1] ? -effect : effect))};
+    // Every active procedure keeps its return offset, saved frame pointer and moved argument on the stack.
+    program.stack_size = 3 * size + 16;
+    return program;
+}
+
+/**
+ * Generates a sequence of arithmetic instructions, operating on two values on the stack.
+ * The instructions are chosen randomly, skipping those that would overflow.
+ */
+static GeneratedProgram generate_arithmetic(size_t size, Random &random) {
+    int32_t second = random_between(random, -1000, 1000), top = random_between(random, -1000, 1000);
+    std::stringstream source;
+    source << "        start\n";
+    source << "        pushc " << second << "\n";
+    source << "        pushc " << top << "\n";
+
+    const auto fits = [](int64_t value) {
+        return value >= std::numeric_limits<int32_t>::min() && value <= std::numeric_limits<int32_t>::max();
+    };
+    for (size_t generated = 0; generated < size;) {
+        const int32_t amount = random_between(random, 1, 1000);
+        int64_t result;
+        switch (random_between(random, 0, 7)) {
+            case 0:
+                if (!fits(result = int64_t{top} + amount)) continue;
+                source << "        inc " << amount << "\n";
+                break;
+            case 1:
+                if (!fits(result = int64_t{top} - amount)) continue;
+                source << "        dec " << amount << "\n";
+                break;
+            case 2:
+                if (!fits(result = -int64_t{top})) continue;
+                source << "        neg\n";
+                break;
+            case 3:
+                if (!fits(result = int64_t{top} + second)) continue;
+                source << "        add\n";
+                break;
+            case 4:
+                if (!fits(result = int64_t{top} - second)) continue;
+                source << "        sub\n";
+                break;
+            case 5:
+                result = top ^ second;
+                source << "        xor\n";
+                break;
+            case 6:
+                result = static_cast<int32_t>(std::rotl(static_cast<uint32_t>(top), second));
+                source << "        shl\n";
+                break;
+            default:
+                result = second;
+                second = top;
+                source << "        swap\n";
+        }
+        top = static_cast<int32_t>(result);
+        generated++;
+    }
+    source << "        stop\n";
+
+    GeneratedProgram program;
+    program.source = source.str();
+    program.result = {top, second};
+    return program;
+}
+
+/**
+ * Generates a .word section and a .bss section of the same size. A loop moves every word
+ * of the former into the latter, while summing up all words.
+ */
+static GeneratedProgram generate_memory(size_t size, Random &random) {
+    std::stringstream source;
+    int32_t sum = 0;
+    // The sum is placed first, since pushm and popm only address the lower memory.
+    source << "sum:\n";
+    source << "    .word 0\n";
+    source << "data:\n";
+    for (size_t i = 0; i < size; i++) {
+        const int32_t value = random_between(random, 0, 99);
+        sum += value;
+        source << (i % 16 == 0 ? "    .word " : " ") << value << (i % 16 == 15 || i + 1 == size ? "\n" : "");
+    }
+    source << "data_end:\n";
+    source << "copy:\n";
+    source << "    .bss " << size << "\n";
+    source << "\n";
+    source << "        start\n";
+    push_wide(source, "data_end");
+    push_wide(source, "data");
+    source << "        pushfalse\n";
+    source << "loop_top: brt loop_bot\n";
+    push_wide(source, "data");
+    source << "        swap\n";
+    source << "        cmpopne\n";
+    pop_wide(source, "data");
+    source << "        load\n";
+    source << "        pushm sum\n";
+    source << "        add\n";
+    source << "        popm sum\n";
+    // The distance between both sections exceeds the operand of store, so the address is computed.
+    source << "        swap\n";
+    push_wide(source, "[copy - data]");
+    source << "        add\n";
+    source << "        dig\n";
+    source << "        store\n";
+    source << "        sub\n";
+    pop_wide(source, "[copy - data]");
+    source << "        inc 1\n";
+    source << "        cmpushne\n";
+    source << "loop_bot: brt loop_top\n";
+    source << "        popfalse\n";
+    pop_wide(source, "data_end");
+    pop_wide(source, "data_end");
+    source << "        pushm sum\n";
+    source << "        stop\n";
+
+    GeneratedProgram program;
+    program.source = source.str();
+    program.result = {sum};
+    program.memory_size = std::max(program.memory_size, 2 * size + 1);
+    return program;
+}
+
+/**
+ * Generates a label for every instruction. Some instructions use constants defined by .set and
+ * some labels are pushed and popped again, referencing labels before and after them.
+ */
+static GeneratedProgram generate_labels(size_t size, Random &random) {
+    std::stringstream source;
+    int32_t counter = 0;
+    source << "        start\n";
+    source << "        pushc 0\n";
+    for (size_t i = 0; i < size; i++) {
+        const std::string label = "label_" + std::to_string(i);
+        if (i % 16 == 0) {
+            const int32_t value = random_between(random, 1, 100);
+            source << ".set constant_" << i << " " << value << "\n";
+            source << label << ": inc constant_" << i << "\n";
+            counter += value;
+
+            const std::string referenced = "label_" + std::to_string(random_between(random, 0, static_cast<int32_t>(size) - 1));
+            push_wide(source, referenced);
+            pop_wide(source, referenced);
+        } else {
+            source << label << ": inc 1\n";
+            counter += 1;
+        }
+    }
+    source << "        stop\n";
+
+    GeneratedProgram program;
+    program.source = source.str();
+    program.result = {counter};
+    return program;
+}
+
+struct Shape {
+    const char *name;
+    std::function<GeneratedProgram(size_t, Random &)> generate;
+};
+
+static const Shape shapes[] = {
+        {"calls",      generate_calls},
+        {"arithmetic", generate_arithmetic},
+        {"memory",     generate_memory},
+        {"labels",     generate_labels},
+};
+
+static const Shape *find_shape(std::string_view name) {
+    for (const Shape &shape: shapes) {
+        if (name == shape.name) return &shape;
+    }
+    return nullptr;
+}
+
+int main(int argc, char *argv[]) {
+    std::filesystem::path output = ".";
+    uint64_t seed = 0;
+    std::vector<std::pair<const Shape *, size_t>> requested;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            cout << "Generates synthetic programs for the reversible stack machine.\n\n";
+            cout << "  " << argv[0] << " [OPTIONS] SHAPE[:SIZE]...\n\n";
+            cout << help_page << endl;
+            return 0;
+        } else if (i + 1 < argc && (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0)) {
+            output = argv[++i];
+        } else if (i + 1 < argc && strcmp(argv[i], "--seed") == 0) {
+            seed = strtoull(argv[++i], nullptr, 10);
+        } else {
+            const std::string_view argument(argv[i]);
+            const size_t separator = argument.find(':');
+            const Shape *shape = find_shape(argument.substr(0, separator));
+            size_t size = 1000;
+            if (separator != std::string_view::npos) {
+                char *end;
+                size = strtoull(argv[i] + separator + 1, &end, 10);
+                if (*end != '\0') shape = nullptr;
+            }
+            if (shape == nullptr || size == 0) {
+                cerr << "Invalid shape or size: " << argv[i] << endl;
+                return 2;
+            }
+            requested.emplace_back(shape, size);
+        }
+    }
+    if (requested.empty()) {
+        cerr << "Missing shape of generated programs. See --help for usage." << endl;
+        return 2;
+    }
+
+    try {
+        std::filesystem::create_directories(output);
+        std::ofstream expected(output / "expected.json");
+        Json::Writer writer(expected);
+        writer.begin_array();
+        for (const auto &[shape, size]: requested) {
+            Random random(seed);
+            const GeneratedProgram program = shape->generate(size, random);
+            const std::string file = std::string(shape->name) + "-" + std::to_string(size) + ".rsc";
+
+            std::ofstream(output / file) << "; Generated by stackmachine-gen " << shape->name << ":" << size
+                                         << " with seed " << seed << ".\n\n" << program.source;
+            writer.begin_object()
+                    .member("file", file)
+                    .member("stacksize", uint64_t{program.stack_size})
+                    .member("memorysize", uint64_t{program.memory_size});
+            writer.key("result").begin_array();
+            for (const int32_t value: program.result) writer.value(value);
+            writer.end_array().end_object();
+            cout << "Generated " << (output / file).string() << endl;
+        }
+        writer.end_array();
+        if (!expected) {
+            throw std::runtime_error("Cannot write " + (output / "expected.json").string() + ".");
+        }
+    } catch (std::exception &exception) {
+        cerr << "[ERROR] " << exception.what() << endl;
+        return 1;
+    }
+    return 0;
+}
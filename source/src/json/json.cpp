@@ -0,0 +1,278 @@
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "json.h"
+#include "messages/error.h"
+
+namespace Json {
+
+    const Value *Value::find(std::string_view key) const {
+        for (const auto &[name, member]: members) {
+            if (name == key) return &member;
+        }
+        return nullptr;
+    }
+
+    class Parser {
+        std::string_view text;
+        const std::string &filename;
+        size_t position = 0;
+
+    public:
+        Parser(std::string_view text, const std::string &filename) : text(text), filename(filename) {}
+
+        [[noreturn]] void invalid(const std::string &reason) const {
+            throw invalid_json(filename, position, reason);
+        }
+
+        void skip_whitespace() {
+            while (position < text.size() && (text[position] == ' ' || text[position] == '\t' ||
+                                              text[position] == '\n' || text[position] == '\r')) {
+                position++;
+            }
+        }
+
+        [[nodiscard]] bool is_at_end() {
+            skip_whitespace();
+            return position >= text.size();
+        }
+
+        bool consume(char expected) {
+            skip_whitespace();
+            if (position < text.size() && text[position] == expected) {
+                position++;
+                return true;
+            }
+            return false;
+        }
+
+        void expect(char expected) {
+            if (!consume(expected)) invalid(std::string("expected '") + expected + "'");
+        }
+
+        bool consume_word(std::string_view word) {
+            if (text.substr(position, word.size()) != word) return false;
+            position += word.size();
+            return true;
+        }
+
+        std::string string() {
+            expect('"');
+            std::string result;
+            while (position < text.size() && text[position] != '"') {
+                char character = text[position++];
+                if (character == '\\') {
+                    if (position >= text.size()) break;
+                    switch (text[position++]) {
+                        case 'n':
+                            character = '\n';
+                            break;
+                        case 't':
+                            character = '\t';
+                            break;
+                        case 'r':
+                            character = '\r';
+                            break;
+                        case '"':
+                            character = '"';
+                            break;
+                        case '\\':
+                            character = '\\';
+                            break;
+                        case '/':
+                            character = '/';
+                            break;
+                        default:
+                            invalid("unsupported escape sequence");
+                    }
+                }
+                result.push_back(character);
+            }
+            expect('"');
+            return result;
+        }
+
+        Value value() {
+            skip_whitespace();
+            if (position >= text.size()) invalid("unexpected end of document");
+
+            Value result;
+            const char next = text[position];
+            if (next == '{') {
+                result.kind = Value::OBJECT;
+                expect('{');
+                if (consume('}')) return result;
+                do {
+                    std::string key = string();
+                    expect(':');
+                    result.members.emplace_back(std::move(key), value());
+                } while (consume(','));
+                expect('}');
+
+            } else if (next == '[') {
+                result.kind = Value::ARRAY;
+                expect('[');
+                if (consume(']')) return result;
+                do {
+                    result.elements.push_back(value());
+                } while (consume(','));
+                expect(']');
+
+            } else if (next == '"') {
+                result.kind = Value::STRING;
+                result.string = string();
+
+            } else if (consume_word("true")) {
+                result.kind = Value::BOOLEAN;
+                result.boolean = true;
+            } else if (consume_word("false")) {
+                result.kind = Value::BOOLEAN;
+            } else if (consume_word("null")) {
+                result.kind = Value::NUL;
+
+            } else {
+                // The text is not necessarily terminated, so the number is copied first.
+                size_t end = position;
+                while (end < text.size() && std::string_view("+-.0123456789eE").find(text[end]) != std::string_view::npos) {
+                    end++;
+                }
+                const std::string number(text.substr(position, end - position));
+                char *number_end;
+                result.kind = Value::NUMBER;
+                result.number = std::strtod(number.c_str(), &number_end);
+                if (number.empty() || *number_end != '\0') invalid("expected a value");
+                position = end;
+            }
+            return result;
+        }
+    };
+
+    Value parse(std::string_view text, const std::string &filename) {
+        Parser parser(text, filename);
+        Value document = parser.value();
+        if (!parser.is_at_end()) parser.invalid("unexpected content after document");
+        return document;
+    }
+
+    Value read_file(const std::string &filename) {
+        std::ifstream input(filename);
+        if (!input) {
+            throw std::invalid_argument("File " + filename + " cannot be opened.");
+        }
+        std::stringstream content;
+        content << input.rdbuf();
+        return parse(content.str(), filename);
+    }
+
+
+    void Writer::begin_value() {
+        if (is_after_key) {
+            is_after_key = false;
+            return;
+        }
+        if (!has_elements.empty()) {
+            if (has_elements.back()) output << ",";
+            has_elements.back() = true;
+            output << "\n" << std::string(2 * has_elements.size(), ' ');
+        }
+    }
+
+    void Writer::end_container(char bracket) {
+        const bool was_empty = !has_elements.back();
+        has_elements.pop_back();
+        if (!was_empty) {
+            output << "\n" << std::string(2 * has_elements.size(), ' ');
+        }
+        output << bracket;
+        if (has_elements.empty()) output << "\n";
+    }
+
+    Writer &Writer::begin_object() {
+        begin_value();
+        output << "{";
+        has_elements.push_back(false);
+        return *this;
+    }
+
+    Writer &Writer::end_object() {
+        end_container('}');
+        return *this;
+    }
+
+    Writer &Writer::begin_array() {
+        begin_value();
+        output << "[";
+        has_elements.push_back(false);
+        return *this;
+    }
+
+    Writer &Writer::end_array() {
+        end_container(']');
+        return *this;
+    }
+
+    Writer &Writer::key(std::string_view key) {
+        value(key);
+        output << ": ";
+        is_after_key = true;
+        return *this;
+    }
+
+    Writer &Writer::value(std::string_view value) {
+        begin_value();
+        output << '"';
+        for (const char character: value) {
+            switch (character) {
+                case '"':
+                    output << "\\\"";
+                    break;
+                case '\\':
+                    output << "\\\\";
+                    break;
+                case '\n':
+                    output << "\\n";
+                    break;
+                case '\t':
+                    output << "\\t";
+                    break;
+                default:
+                    output << character;
+            }
+        }
+        output << '"';
+        return *this;
+    }
+
+    Writer &Writer::value(double value) {
+        begin_value();
+        if (std::isfinite(value)) {
+            // The stream belongs to the caller, so its precision is restored afterwards.
+            const auto precision = output.precision(10);
+            output << value;
+            output.precision(precision);
+        } else {
+            output << "null"; // Not representable in JSON.
+        }
+        return *this;
+    }
+
+    Writer &Writer::value(int64_t value) {
+        begin_value();
+        output << value;
+        return *this;
+    }
+
+    Writer &Writer::value(uint64_t value) {
+        begin_value();
+        output << value;
+        return *this;
+    }
+
+    Writer &Writer::value(bool value) {
+        begin_value();
+        output << (value ? "true" : "false");
+        return *this;
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+/**
+ * This header provides reading and writing of JSON documents, which are used
+ * for machine-readable results like benchmark reports.
+ *
+ * Only what these results require is supported: numbers are represented as
+ * double and strings are not unescaped beyond the basic escape sequences.
+ */
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace Json {
+
+    struct Value {
+        enum Kind : uint8_t {
+            NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT
+        } kind = NUL;
+
+        bool boolean = false;
+        double number = 0;
+        std::string string;
+        std::vector<Value> elements;
+        std::vector<std::pair<std::string, Value>> members;
+
+        /**
+         * Returns the member of an object with the given key, or nullptr if there is none.
+         */
+        [[nodiscard]] const Value *find(std::string_view key) const;
+    };
+
+    /**
+     * Parses a JSON document. The filename is only used for error messages.
+     *
+     * @throws invalid_json if the document is malformed.
+     */
+    [[nodiscard]] Value parse(std::string_view text, const std::string &filename);
+
+    /**
+     * Reads and parses a JSON document from a file.
+     */
+    [[nodiscard]] Value read_file(const std::string &filename);
+
+    /**
+     * Writes a JSON document to a stream, placing every member and element on its own line.
+     * Separators are inserted automatically, so values are simply written in order.
+     */
+    class Writer {
+        std::ostream &output;
+        std::vector<bool> has_elements;
+        bool is_after_key = false;
+
+        void begin_value();
+
+        void end_container(char bracket);
+
+    public:
+        explicit Writer(std::ostream &output) : output(output) {}
+
+        Writer &begin_object();
+
+        Writer &end_object();
+
+        Writer &begin_array();
+
+        Writer &end_array();
+
+        Writer &key(std::string_view key);
+
+        Writer &value(std::string_view value);
+
+        Writer &value(const char *value) {
+            return this->value(std::string_view(value));
+        }
+
+        Writer &value(double value);
+
+        Writer &value(int64_t value);
+
+        Writer &value(int32_t value) {
+            return this->value(static_cast<int64_t>(value));
+        }
+
+        Writer &value(uint64_t value);
+
+        Writer &value(bool value);
+
+        template<typename T>
+        Writer &member(std::string_view name, T value) {
+            return this->key(name).value(value);
+        }
+    };
+}
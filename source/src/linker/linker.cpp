@@ -0,0 +1,168 @@
+/**
+ * Combines multiple modules into a single program. Code of all modules is
+ * placed in order, data of every module is placed in a contiguous memory
+ * area avoiding all addresses fixed by .set directives.
+ */
+
+#include <cstdio>
+#include <unordered_map>
+#include "module.h"
+#include "messages/error.h"
+
+namespace Linker {
+    using Assembler::AddressRanges;
+    using Assembler::MemoryLayout;
+
+    constexpr int32_t START_BINARY = 0;
+    constexpr int32_t STOP_BINARY = INVERSE(START_BINARY);
+
+    struct Placement {
+        int32_t code_base;
+        int32_t data_base;
+    };
+
+    // Symbols are interned, so they can be compared by their address.
+    using GlobalSymbols = std::unordered_map<const char *, int32_t>;
+
+    [[nodiscard]] static int32_t resolve(const Relocatable &value, const Placement &placement,
+                                         const GlobalSymbols &globals) {
+        // Compute with wrap-around, like the assembler does with 32-bit words.
+        uint32_t result = static_cast<uint32_t>(value.constant) +
+                          static_cast<uint32_t>(value.code_coefficient) * static_cast<uint32_t>(placement.code_base) +
+                          static_cast<uint32_t>(value.data_coefficient) * static_cast<uint32_t>(placement.data_base);
+        for (const Import &import: value.imports) {
+            auto global = globals.find(import.symbol);
+            if (global == globals.end()) {
+                throw invalid_operand("Unknown symbol.");
+            }
+            result += static_cast<uint32_t>(import.sign) * static_cast<uint32_t>(global->second);
+        }
+        return static_cast<int32_t>(result);
+    }
+
+    /**
+     * Runs an action for a single module, reporting errors with the module name.
+     */
+    template<typename Action>
+    static void within_module(const Module &module, Action action) {
+        int32_t linenumber = -1;
+        try {
+            action(linenumber);
+        } catch (error_message &error) {
+            if (linenumber >= 0) error.setLineNumber(linenumber);
+            throw error_message(module.name + ": " + error.getMessage());
+        }
+    }
+
+    [[nodiscard]] static std::vector<Placement> place_modules(const std::vector<Module> &modules) {
+        std::vector<Placement> placements(modules.size());
+
+        AddressRanges reserved_ranges;
+        for (const Module &module: modules) {
+            within_module(module, [&](int32_t &linenumber) {
+                for (const FixedWord &word: module.fixed) {
+                    linenumber = word.linenumber;
+                    if (reserved_ranges.contains(word.address)) {
+                        throw set_address_clash(word.address);
+                    }
+                    reserved_ranges.reserve(word.address, 1);
+                }
+            });
+        }
+
+        int64_t code_base = 0;
+        int32_t data_base = 0;
+        for (size_t i = 0; i < modules.size(); i++) {
+            const int64_t data_size = static_cast<int64_t>(modules[i].data.size()) + modules[i].bss_size;
+            if (data_size > INT32_MAX || code_base > INT32_MAX)
+                throw std::out_of_range("Requested memory cannot be allocated with current layout.");
+
+            const int64_t address = reserved_ranges.find_free(data_base, static_cast<int32_t>(data_size));
+            if (address + data_size > INT32_MAX)
+                throw std::out_of_range("Requested memory cannot be allocated with current layout.");
+            reserved_ranges.reserve(static_cast<int32_t>(address), static_cast<int32_t>(data_size));
+
+            placements[i] = {static_cast<int32_t>(code_base), static_cast<int32_t>(address)};
+            data_base = static_cast<int32_t>(address + data_size);
+            code_base += static_cast<int64_t>(modules[i].code.size());
+        }
+        return placements;
+    }
+
+    [[nodiscard]] static GlobalSymbols collect_exports(const std::vector<Module> &modules,
+                                                       const std::vector<Placement> &placements) {
+        GlobalSymbols globals;
+        for (size_t i = 0; i < modules.size(); i++) {
+            for (const Export &exported: modules[i].exports) {
+                int32_t value = exported.value;
+                if (exported.kind == SymbolKind::CODE) value += placements[i].code_base;
+                if (exported.kind == SymbolKind::DATA) value += placements[i].data_base;
+
+                if (!globals.emplace(exported.symbol, value).second) {
+                    throw error_message(modules[i].name + ": " +
+                                        symbol_redefinition_error(exported.symbol).getMessage());
+                }
+            }
+        }
+        return globals;
+    }
+
+    [[nodiscard]] std::tuple<MemoryLayout, std::vector<int32_t>, int32_t> link(const std::vector<Module> &modules) {
+        const std::vector<Placement> placements = place_modules(modules);
+        const GlobalSymbols globals = collect_exports(modules, placements);
+
+        MemoryLayout memory;
+        std::vector<int32_t> code;
+        bool contains_start = false, contains_stop = false;
+        int32_t entry_address = -1;
+
+        for (size_t i = 0; i < modules.size(); i++) {
+            const Module &module = modules[i];
+            const Placement &placement = placements[i];
+
+            within_module(module, [&](int32_t &linenumber) {
+                for (const ModuleInstruction &instruction: module.code) {
+                    linenumber = instruction.linenumber;
+                    const int32_t position = static_cast<int32_t>(code.size());
+
+                    // Check for duplicate start/stop instructions.
+                    if (instruction.binary == START_BINARY) {
+                        if (contains_start) throw start_stop_presence("start");
+                        contains_start = true;
+                        entry_address = position;
+                    } else if (instruction.binary == STOP_BINARY) {
+                        if (contains_stop) throw start_stop_presence("stop");
+                        contains_stop = true;
+                    }
+
+                    const InstructionData &data = InstructionData::get(instruction.binary & ~DIRECTION_BIT,
+                                                                       (instruction.binary & DIRECTION_BIT) == 0);
+                    const int32_t operand = resolve(instruction.operand, placement, globals);
+                    if (data.operand_mode == OperandMode::NO_OPERAND && operand != 0) {
+                        fprintf(stderr, "[WARNING] %s: %s\n", module.name.c_str(),
+                                Assembler::discarded_operand_warning(data, operand, linenumber).c_str());
+                    }
+                    code.push_back(Assembler::encode_instruction(data, operand, position));
+                }
+
+                int32_t address = placement.data_base;
+                for (const ModuleWord &word: module.data) {
+                    linenumber = word.linenumber;
+                    memory.store(address++, resolve(word.value, placement, globals));
+                }
+                memory.reserve(address, module.bss_size);
+
+                for (const FixedWord &word: module.fixed) {
+                    linenumber = word.linenumber;
+                    memory.store(word.address, resolve(word.value, placement, globals));
+                }
+            });
+        }
+        memory.seal();
+
+        if (!contains_start) throw start_stop_presence("start");
+        if (!contains_stop) throw start_stop_presence("stop");
+
+        return {memory, code, entry_address};
+    }
+}
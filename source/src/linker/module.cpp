@@ -0,0 +1,214 @@
+/**
+ * Assembles a program into a relocatable module. Symbols are resolved
+ * relative to the modules code and data, operands referencing them
+ * are kept as relocatable values.
+ */
+
+#include <set>
+#include <stdexcept>
+#include <unordered_map>
+#include "module.h"
+#include "messages/error.h"
+
+namespace Linker {
+    using Assembler::restrict_eval;
+
+    struct Definition {
+        SymbolKind kind;
+        int32_t value;
+    };
+
+    // Symbols are interned, so they can be compared by their address.
+    using Definitions = std::unordered_map<const char *, Definition>;
+
+    [[nodiscard]] static Relocatable relocatable_constant(int32_t value) {
+        Relocatable result;
+        result.constant = value;
+        return result;
+    }
+
+    [[nodiscard]] static Relocatable relocatable_position(SymbolKind kind, int32_t offset) {
+        Relocatable result = relocatable_constant(offset);
+        if (kind == SymbolKind::CODE) result.code_coefficient = 1;
+        if (kind == SymbolKind::DATA) result.data_coefficient = 1;
+        return result;
+    }
+
+    [[nodiscard]] static Relocatable combine(Relocatable lhs, const Relocatable &rhs, int32_t sign) {
+        lhs.constant += sign * rhs.constant;
+        lhs.code_coefficient += sign * rhs.code_coefficient;
+        lhs.data_coefficient += sign * rhs.data_coefficient;
+        for (const Import &import: rhs.imports) {
+            lhs.imports.push_back({import.symbol, sign * import.sign});
+        }
+        return lhs;
+    }
+
+    [[nodiscard]] static Relocatable eval_relocatable(const PrimitiveOperand &operand, const Relocatable &position,
+                                                      const Definitions &definitions) {
+        switch (operand.variant) {
+            case PRIMITIVE_SYMBOL: {
+                auto definition = definitions.find(operand.value.symbol);
+                if (definition != definitions.end()) {
+                    return relocatable_position(definition->second.kind, definition->second.value);
+                }
+
+                // Symbols not defined in this module are imported.
+                Relocatable result;
+                result.imports.push_back({operand.value.symbol, 1});
+                return result;
+            }
+
+            case PRIMITIVE_CONSTANT:
+                return relocatable_constant(operand.value.constant);
+
+            case PRIMITIVE_RELATIVE:
+                return combine(position, relocatable_constant(operand.value.relative), 1);
+
+            default:
+                throw invalid_operand("Not a valid operand.");
+        }
+    }
+
+    [[nodiscard]] static Relocatable eval_relocatable(const Operand &operand, const Relocatable &position,
+                                                      const Definitions &definitions) {
+        switch (operand.variant) {
+            case PRIMITIVE_SYMBOL:
+            case PRIMITIVE_CONSTANT:
+            case PRIMITIVE_RELATIVE:
+                return eval_relocatable(operand.instance.primitive, position, definitions);
+            case NO_OPERAND:
+                return {};
+            case COMPLEX_ADD:
+                return combine(eval_relocatable(operand.instance.complex.lhs, position, definitions),
+                               eval_relocatable(operand.instance.complex.rhs, position, definitions), 1);
+            case COMPLEX_SUB:
+                return combine(eval_relocatable(operand.instance.complex.lhs, position, definitions),
+                               eval_relocatable(operand.instance.complex.rhs, position, definitions), -1);
+            default:
+                throw invalid_operand("Not a valid operand.");
+        }
+    }
+
+    static void define(Definitions &definitions, const char *symbol, SymbolKind kind, int32_t value) {
+        if (!definitions.emplace(symbol, Definition{kind, value}).second) {
+            throw symbol_redefinition_error(symbol);
+        }
+    }
+
+    static void define_labels(Definitions &definitions, const Line &line, SymbolKind kind, int32_t value) {
+        for (StringList *labels = line.labels; !labels->isEmpty; labels = labels->tail) {
+            define(definitions, labels->head, kind, value);
+        }
+    }
+
+    [[nodiscard]] static int32_t count_words(const Line &line) {
+        int32_t size = 0;
+        for (OperandList *list = line.value.words.data; !list->isEmpty; list = list->tail) {
+            size++;
+        }
+        return size;
+    }
+
+    /**
+     * Defines all symbols of a program, following the same order as Assembler::resolve_symbols.
+     * Data is laid out contiguously starting at offset 0, followed by all reserved words.
+     */
+    [[nodiscard]] static Definitions define_symbols(const Program &program, int32_t &data_size, int32_t &bss_size) {
+        Definitions definitions;
+
+        std::set<int32_t> fixed_addresses;
+        iterate_section(program.data, [&](const Line &line) {
+            if (line.variant == LINE_SET && line.value.setValue.memoryAddress.variant != PRIMITIVE_SYMBOL) {
+                const int32_t address = restrict_eval(line.value.setValue.memoryAddress);
+                if (!fixed_addresses.insert(address).second) {
+                    throw set_address_clash(address);
+                }
+                define_labels(definitions, line, SymbolKind::ABSOLUTE, address);
+            } else if (line.variant == LINE_SET) {
+                const int32_t value = restrict_eval(line.value.setValue.value);
+                define(definitions, line.value.setValue.memoryAddress.instance.primitive.value.symbol,
+                       SymbolKind::ABSOLUTE, value);
+                define_labels(definitions, line, SymbolKind::ABSOLUTE, value);
+            }
+        });
+
+        data_size = 0;
+        iterate_section(program.data, [&](const Line &line) {
+            if (line.variant == LINE_WORDS) {
+                define_labels(definitions, line, SymbolKind::DATA, data_size);
+                data_size += count_words(line);
+            } else if (line.variant != LINE_SET) {
+                throw illegal_section_content();
+            }
+        });
+
+        bss_size = 0;
+        iterate_section(program.bss, [&](const Line &line) {
+            if (line.variant != LINE_RESERVED) {
+                throw illegal_section_content();
+            }
+
+            const int32_t size = restrict_eval(line.value.reserved.size);
+            if (size < 0 || data_size + bss_size + size < 0)
+                throw std::out_of_range("Requested memory cannot be allocated with current layout.");
+            define_labels(definitions, line, SymbolKind::DATA, data_size + bss_size);
+            bss_size += size;
+        });
+
+        int32_t instruction_count = 0;
+        iterate_section(program.code, [&](const Line &line) {
+            if (line.variant != LINE_INSTRUCTION) {
+                throw illegal_section_content();
+            }
+            define_labels(definitions, line, SymbolKind::CODE, instruction_count++);
+        });
+
+        return definitions;
+    }
+
+    [[nodiscard]] Module assemble_module(const Program &program, const std::string &name) {
+        Module module;
+        module.name = name;
+
+        int32_t data_size;
+        const Definitions definitions = define_symbols(program, data_size, module.bss_size);
+
+        module.data.reserve(data_size);
+        iterate_section(program.data, [&](const Line &line) {
+            if (line.variant == LINE_WORDS) {
+                for (OperandList *list = line.value.words.data; !list->isEmpty; list = list->tail) {
+                    const Relocatable position = relocatable_position(SymbolKind::DATA,
+                                                                      static_cast<int32_t>(module.data.size()));
+                    module.data.push_back({line.linenumber, eval_relocatable(list->head, position, definitions)});
+                }
+            } else if (line.value.setValue.memoryAddress.variant != PRIMITIVE_SYMBOL) {
+                const int32_t address = restrict_eval(line.value.setValue.memoryAddress);
+                module.fixed.push_back({address, line.linenumber,
+                                        eval_relocatable(line.value.setValue.value,
+                                                         relocatable_constant(address), definitions)});
+            }
+        });
+
+        module.code.reserve(program.code.size());
+        iterate_section(program.code, [&](const Line &line) {
+            const Relocatable position = relocatable_position(SymbolKind::CODE,
+                                                              static_cast<int32_t>(module.code.size()));
+            module.code.push_back({line.value.instruction.data->binary, line.linenumber,
+                                   eval_relocatable(line.value.instruction.operand, position, definitions)});
+        });
+
+        std::set<const char *> exported;
+        for (const char *symbol: program.exports) {
+            auto definition = definitions.find(symbol);
+            if (definition == definitions.end()) {
+                throw undefined_export(symbol);
+            }
+            if (exported.insert(symbol).second) {
+                module.exports.push_back({symbol, definition->second.kind, definition->second.value});
+            }
+        }
+
+        return module;
+    }
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+/**
+ * Interface for separate assembly and linking of modules.
+ *
+ * A module is a program assembled without knowing where its code and data
+ * will be placed. Every operand is kept as a relocatable value, which is
+ * resolved once all modules are combined by the linker. Symbols exported
+ * by a module can be referenced by all other modules. Symbols not defined
+ * within a module are imported.
+ *
+ * @see Module assemble_module(const Program &program, const std::string &name)
+ * @see std::tuple<MemoryLayout, std::vector<int32_t>, int32_t> link(const std::vector<Module> &modules)
+ */
+
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "assembler/assembler.h"
+#include "syntax/syntax.h"
+
+namespace Linker {
+
+    enum class SymbolKind : uint8_t {
+        /**
+         * The value of the symbol does not depend on the placement of the module.
+         */
+        ABSOLUTE,
+        /**
+         * The value of the symbol is an offset into the modules code.
+         */
+        CODE,
+        /**
+         * The value of the symbol is an offset into the modules data.
+         */
+        DATA
+    };
+
+    struct Import {
+        const char *symbol; // Interned symbol name.
+        int32_t sign;
+    };
+
+    /**
+     * A value depending on the placement of modules, which is computed as
+     *   constant + code_coefficient * code_base + data_coefficient * data_base + (sum of imports)
+     * where code_base and data_base are the addresses a module is placed at.
+     */
+    struct Relocatable {
+        int32_t constant = 0;
+        int32_t code_coefficient = 0;
+        int32_t data_coefficient = 0;
+        std::vector<Import> imports;
+    };
+
+    struct ModuleInstruction {
+        int32_t binary;
+        int32_t linenumber;
+        Relocatable operand;
+    };
+
+    struct ModuleWord {
+        int32_t linenumber;
+        Relocatable value;
+    };
+
+    /**
+     * A word placed at a fixed address using the .set directive.
+     */
+    struct FixedWord {
+        int32_t address;
+        int32_t linenumber;
+        Relocatable value;
+    };
+
+    struct Export {
+        const char *symbol; // Interned symbol name.
+        SymbolKind kind;
+        int32_t value;
+    };
+
+    struct Module {
+        std::string name;
+        std::vector<ModuleInstruction> code;
+        /**
+         * Initialized data words, placed contiguously and followed by bss_size zeroed words.
+         */
+        std::vector<ModuleWord> data;
+        int32_t bss_size = 0;
+        std::vector<FixedWord> fixed;
+        std::vector<Export> exports;
+    };
+
+    /**
+     * Assembles a Program into a Module, without resolving the placement of code and data.
+     */
+    [[nodiscard]] Module assemble_module(const Program &program, const std::string &name);
+
+    /**
+     * Writes a Module to an object file.
+     */
+    void write_module(const std::string &filename, const Module &module);
+
+    /**
+     * Reads a Module from an object file.
+     */
+    [[nodiscard]] Module read_module(const std::string &filename);
+
+    /**
+     * Checks whether a file starts with the signature of an object file. Only regular files are
+     * read, since reading would consume pipes. Other files are recognized by their extension.
+     */
+    [[nodiscard]] bool is_object_file(const std::string &filename);
+
+    /**
+     * Places all modules in order, resolves imported symbols and relocates all values.
+     *
+     * @return The MemoryLayout, translated instructions and entry point of the combined program,
+     * in the same form as returned by Assembler::assemble.
+     */
+    [[nodiscard]] std::tuple<Assembler::MemoryLayout, std::vector<int32_t>, int32_t> link(
+            const std::vector<Module> &modules);
+}
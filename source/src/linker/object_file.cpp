@@ -0,0 +1,297 @@
+/**
+ * Reading and writing of object files holding a single Module.
+ *
+ * All integers are stored as 32-bit little endian words. Symbol names are
+ * stored once in a table at the beginning of the file and referenced by
+ * their index afterwards.
+ *
+ *   file        ::= "RSMO" version symbols code data bss_size fixed exports
+ *   symbols     ::= count (length bytes)*
+ *   code        ::= count (binary linenumber relocatable)*
+ *   data        ::= count (linenumber relocatable)*
+ *   fixed       ::= count (address linenumber relocatable)*
+ *   exports     ::= count (symbol kind value)*
+ *   relocatable ::= constant code_coefficient data_coefficient count (symbol sign)*
+ */
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+#include "module.h"
+#include "messages/error.h"
+
+namespace Linker {
+
+    static constexpr char MAGIC[4] = {'R', 'S', 'M', 'O'};
+    static constexpr uint32_t VERSION = 1;
+
+    class ObjectWriter {
+        std::ofstream out;
+        std::unordered_map<const char *, uint32_t> symbol_indices;
+
+    public:
+        explicit ObjectWriter(const std::string &filename) : out(filename, std::ios::binary) {
+            if (!out) {
+                throw std::invalid_argument("File " + filename + " cannot be opened.");
+            }
+        }
+
+        void word(uint32_t value) {
+            const char bytes[4] = {
+                    static_cast<char>(value), static_cast<char>(value >> 8),
+                    static_cast<char>(value >> 16), static_cast<char>(value >> 24)
+            };
+            out.write(bytes, sizeof(bytes));
+        }
+
+        void symbol(const char *symbol) {
+            word(symbol_indices.at(symbol));
+        }
+
+        void collect_symbol(const char *symbol) {
+            symbol_indices.emplace(symbol, static_cast<uint32_t>(symbol_indices.size()));
+        }
+
+        void symbol_table() {
+            std::vector<const char *> symbols(symbol_indices.size());
+            for (const auto &[symbol, index]: symbol_indices) {
+                symbols[index] = symbol;
+            }
+
+            word(symbols.size());
+            for (const char *symbol: symbols) {
+                const size_t length = strlen(symbol);
+                word(length);
+                out.write(symbol, static_cast<std::streamsize>(length));
+            }
+        }
+
+        void relocatable(const Relocatable &value) {
+            word(value.constant);
+            word(value.code_coefficient);
+            word(value.data_coefficient);
+            word(value.imports.size());
+            for (const Import &import: value.imports) {
+                symbol(import.symbol);
+                word(import.sign);
+            }
+        }
+
+        void magic() {
+            out.write(MAGIC, sizeof(MAGIC));
+        }
+
+        [[nodiscard]] bool good() const {
+            return out.good();
+        }
+    };
+
+    void write_module(const std::string &filename, const Module &module) {
+        ObjectWriter writer(filename);
+
+        const auto collect_imports = [&](const Relocatable &value) {
+            for (const Import &import: value.imports) writer.collect_symbol(import.symbol);
+        };
+        for (const auto &instruction: module.code) collect_imports(instruction.operand);
+        for (const auto &word: module.data) collect_imports(word.value);
+        for (const auto &word: module.fixed) collect_imports(word.value);
+        for (const auto &exported: module.exports) writer.collect_symbol(exported.symbol);
+
+        writer.magic();
+        writer.word(VERSION);
+        writer.symbol_table();
+
+        writer.word(module.code.size());
+        for (const auto &instruction: module.code) {
+            writer.word(instruction.binary);
+            writer.word(instruction.linenumber);
+            writer.relocatable(instruction.operand);
+        }
+
+        writer.word(module.data.size());
+        for (const auto &word: module.data) {
+            writer.word(word.linenumber);
+            writer.relocatable(word.value);
+        }
+
+        writer.word(module.bss_size);
+
+        writer.word(module.fixed.size());
+        for (const auto &word: module.fixed) {
+            writer.word(word.address);
+            writer.word(word.linenumber);
+            writer.relocatable(word.value);
+        }
+
+        writer.word(module.exports.size());
+        for (const auto &exported: module.exports) {
+            writer.symbol(exported.symbol);
+            writer.word(static_cast<uint32_t>(exported.kind));
+            writer.word(exported.value);
+        }
+
+        if (!writer.good()) {
+            throw std::invalid_argument("File " + filename + " cannot be written.");
+        }
+    }
+
+
+    class ObjectReader {
+        std::ifstream in;
+        std::string filename;
+        std::vector<const char *> symbols;
+
+    public:
+        explicit ObjectReader(const std::string &filename) : in(filename, std::ios::binary), filename(filename) {
+            if (!in) {
+                throw std::invalid_argument("File " + filename + " cannot be opened.");
+            }
+        }
+
+        [[noreturn]] void invalid() const {
+            throw invalid_object_file(filename);
+        }
+
+        uint32_t word() {
+            unsigned char bytes[4];
+            if (!in.read(reinterpret_cast<char *>(bytes), sizeof(bytes))) {
+                invalid();
+            }
+            return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+        }
+
+        int32_t signed_word() {
+            return static_cast<int32_t>(word());
+        }
+
+        /**
+         * Reads a count of elements, each occupying at least the given amount of bytes.
+         * Counts exceeding the remaining file are rejected before anything is allocated for them.
+         */
+        size_t count(size_t minimum_element_size) {
+            const uint32_t count = word();
+            const auto position = in.tellg();
+            in.seekg(0, std::ios::end);
+            const auto remaining = static_cast<size_t>(in.tellg() - position);
+            in.seekg(position);
+            if (count > remaining / minimum_element_size) {
+                invalid();
+            }
+            return count;
+        }
+
+        const char *symbol() {
+            const uint32_t index = word();
+            if (index >= symbols.size()) {
+                invalid();
+            }
+            return symbols[index];
+        }
+
+        void symbol_table() {
+            const size_t symbol_count = count(4);
+            symbols.reserve(symbol_count);
+            for (size_t i = 0; i < symbol_count; i++) {
+                std::string name(count(1), '\0');
+                if (!in.read(name.data(), static_cast<std::streamsize>(name.size()))) {
+                    invalid();
+                }
+                symbols.push_back(internSymbol(name.data(), name.size()));
+            }
+        }
+
+        Relocatable relocatable() {
+            Relocatable value;
+            value.constant = signed_word();
+            value.code_coefficient = signed_word();
+            value.data_coefficient = signed_word();
+            const size_t import_count = count(8);
+            for (size_t i = 0; i < import_count; i++) {
+                const char *imported = symbol();
+                value.imports.push_back({imported, signed_word()});
+            }
+            return value;
+        }
+
+        void magic() {
+            char magic[sizeof(MAGIC)];
+            if (!in.read(magic, sizeof(magic)) || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+                invalid();
+            }
+        }
+    };
+
+    [[nodiscard]] static bool is_known_instruction(int32_t binary) {
+        const size_t offset = binary & ~DIRECTION_BIT;
+        return binary >= 0 && offset < sizeof(KNOWN_INSTRUCTIONS) / sizeof(*KNOWN_INSTRUCTIONS);
+    }
+
+    [[nodiscard]] Module read_module(const std::string &filename) {
+        ObjectReader reader(filename);
+        Module module;
+        module.name = filename;
+
+        reader.magic();
+        if (reader.word() != VERSION) {
+            reader.invalid();
+        }
+        reader.symbol_table();
+
+        module.code.resize(reader.count(20));
+        for (auto &instruction: module.code) {
+            instruction.binary = reader.signed_word();
+            instruction.linenumber = reader.signed_word();
+            instruction.operand = reader.relocatable();
+            if (!is_known_instruction(instruction.binary)) {
+                reader.invalid();
+            }
+        }
+
+        module.data.resize(reader.count(20));
+        for (auto &word: module.data) {
+            word.linenumber = reader.signed_word();
+            word.value = reader.relocatable();
+        }
+
+        module.bss_size = reader.signed_word();
+        if (module.bss_size < 0) {
+            reader.invalid();
+        }
+
+        module.fixed.resize(reader.count(24));
+        for (auto &word: module.fixed) {
+            word.address = reader.signed_word();
+            word.linenumber = reader.signed_word();
+            word.value = reader.relocatable();
+        }
+
+        module.exports.resize(reader.count(12));
+        for (auto &exported: module.exports) {
+            exported.symbol = reader.symbol();
+            const uint32_t kind = reader.word();
+            if (kind > static_cast<uint32_t>(SymbolKind::DATA)) {
+                reader.invalid();
+            }
+            exported.kind = static_cast<SymbolKind>(kind);
+            exported.value = reader.signed_word();
+        }
+
+        return module;
+    }
+
+    [[nodiscard]] bool is_object_file(const std::string &filename) {
+        if (filename == STDIN_FILENAME) {
+            return false; // Don't consume standard input.
+        }
+
+        std::error_code error;
+        if (!std::filesystem::is_regular_file(filename, error)) {
+            return std::filesystem::path(filename).extension() == ".rso";
+        }
+
+        std::ifstream in(filename, std::ios::binary);
+        char magic[sizeof(MAGIC)];
+        return in.read(magic, sizeof(magic)) && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+    }
+}
@@ -1,7 +1,10 @@
 
+#include <algorithm>
 #include <bit>
+#include <cstring>
 #include <stdexcept>
 #include <cstdarg>
+#include <optional>
 #include "machine.h"
 #include "syntax/instructions.h"
 
@@ -47,13 +50,13 @@ static void clear(int32_t &value, int32_t expected) {
     }
 }
 
-static char message_buffer[265];
-
 template<typename Error>
 static void report_error(const char *message_format, ...) {
     va_list format_args;
     va_start(format_args, message_format);
 
+    // Machines may run on several threads at once, so every error is formatted into its own buffer.
+    char message_buffer[265];
     vsnprintf(message_buffer, sizeof(message_buffer), message_format, format_args);
 
     va_end(format_args);
@@ -140,8 +143,11 @@ namespace Machine {
         const int32_t instruction = program.at(pc);
         const int32_t operand = sign_extend(instruction & OPERAND_WIDTH_MASK);
         const int32_t opcode = (instruction >> OPERAND_WIDTH) & OPCODE_WIDTH_MASK;
+        this->execute(dir == Forward ? opcode : INVERSE(opcode), operand);
+    }
 
-        switch (dir == Forward ? opcode : INVERSE(opcode)) {
+    void VM::execute(const int32_t opcode, const int32_t operand) {
+        switch (opcode) {
             case opcode_for("start"):
                 if (this->running) {
                     throw std::logic_error(
@@ -438,11 +444,11 @@ namespace Machine {
             case INVERSE(opcode_for("xorhc")):
                 REQUIRES_PARAMS(1)
                 // Don't use operand here, since it is sign-extended and we want the raw bits.
-                stack[sp - 1] ^= (instruction & OPCODE_WIDTH_MASK) << (OPERAND_WIDTH - 1);
+                stack[sp - 1] ^= (program[pc] & OPCODE_WIDTH_MASK) << (OPERAND_WIDTH - 1);
                 break;
 
             default:
-                throw illegal_instruction(instruction, opcode);
+                throw illegal_instruction(program[pc], (program[pc] >> OPERAND_WIDTH) & OPCODE_WIDTH_MASK);
         }
     }
 
@@ -453,9 +459,393 @@ namespace Machine {
         this->step_pc();
     }
 
+    /**
+     * Returns the raw bits xor-ed onto the stack by an xorhc instruction.
+     */
+    [[nodiscard]] static int32_t xorhc_value(int32_t instruction) {
+        return static_cast<int32_t>(static_cast<uint32_t>(instruction & OPCODE_WIDTH_MASK) << (OPERAND_WIDTH - 1));
+    }
+
+    [[nodiscard]] static int32_t opcode_of(int32_t instruction, Direction dir) {
+        const int32_t opcode = (instruction >> OPERAND_WIDTH) & OPCODE_WIDTH_MASK;
+        return dir == Forward ? opcode : INVERSE(opcode);
+    }
+
+    [[nodiscard]] static bool is_xorhc(int32_t opcode) {
+        return opcode == opcode_for("xorhc") || opcode == INVERSE(opcode_for("xorhc"));
+    }
+
+    /**
+     * Fuses two instructions executed one after another in the given direction.
+     */
+    [[nodiscard]] static Specialization fuse(int32_t first, int32_t second, Direction dir, int32_t next) {
+        const int32_t first_opcode = opcode_of(first, dir), second_opcode = opcode_of(second, dir);
+
+        if (first_opcode == opcode_for("pushc") && is_xorhc(second_opcode)) {
+            return {Specialized::PUSH_WIDE, sign_extend(first & OPERAND_WIDTH_MASK), xorhc_value(second), next};
+        }
+        if (is_xorhc(first_opcode) && second_opcode == opcode_for("popc")) {
+            return {Specialized::POP_WIDE, sign_extend(second & OPERAND_WIDTH_MASK), xorhc_value(first), next};
+        }
+        return {};
+    }
+
+    [[nodiscard]] static Specialized jump_kind(int32_t instruction) {
+        // Branches behave the same in both directions.
+        switch ((instruction >> OPERAND_WIDTH) & OPCODE_WIDTH_MASK & ~DIRECTION_BIT) {
+            case opcode_for("branch"):
+                return Specialized::JUMP;
+            case opcode_for("brt"):
+                return Specialized::JUMP_IF_TRUE;
+            case opcode_for("brf"):
+                return Specialized::JUMP_IF_FALSE;
+            default:
+                return Specialized::NONE;
+        }
+    }
+
+    /**
+     * Fuses the branch at an address with the branch it jumps to, if the latter always ends the jump.
+     * In both directions the jump targets the same address, since the direction is applied to br twice.
+     */
+    [[nodiscard]] static Specialization fuse_jump(const std::vector<int32_t> &program, size_t address, Direction dir) {
+        const Specialized kind = jump_kind(program[address]);
+        const int32_t offset = sign_extend(program[address] & OPERAND_WIDTH_MASK);
+        const int64_t target = static_cast<int64_t>(address) + offset;
+        if (kind == Specialized::NONE || offset == 0 || target < 0 || target >= static_cast<int64_t>(program.size())) {
+            return {};
+        }
+
+        const Specialized target_kind = jump_kind(program[target]);
+        const int32_t target_offset = sign_extend(program[target] & OPERAND_WIDTH_MASK);
+        if (target_offset != -offset || (target_kind != Specialized::JUMP && target_kind != kind)) {
+            return {};
+        }
+        return {kind, 0, 0, static_cast<int32_t>(target + dir)};
+    }
+
+    /**
+     * Returns the instruction executed a number of instructions after the one at an address, if there is one.
+     */
+    [[nodiscard]] static std::optional<int32_t> instruction_after(const std::vector<int32_t> &program, size_t address,
+                                                                  int64_t count, Direction dir) {
+        const int64_t index = static_cast<int64_t>(address) + count * dir;
+        if (index < 0 || index >= static_cast<int64_t>(program.size())) return std::nullopt;
+        return program[index];
+    }
+
+    /**
+     * Specializes a memory access at an address, executed in the given direction. A memory access
+     * through a local variable, which is moved onto the stack and back around it, is combined with
+     * the surrounding instructions.
+     */
+    [[nodiscard]] static Specialization specialize_memory(const std::vector<int32_t> &program, size_t address,
+                                                          Direction dir) {
+        const int32_t first = program[address], first_opcode = opcode_of(first, dir);
+        const int32_t operand = sign_extend(first & OPERAND_WIDTH_MASK);
+
+        const auto second = instruction_after(program, address, 1, dir);
+        const auto third = instruction_after(program, address, 2, dir);
+        const auto last = instruction_after(program, address, 3, dir);
+        if (first_opcode == opcode_for("pushl") && second.has_value() && third.has_value() && last.has_value() &&
+            opcode_of(last.value(), dir) == opcode_for("popl") &&
+            sign_extend(last.value() & OPERAND_WIDTH_MASK) == operand) {
+            const int32_t next = static_cast<int32_t>(address) + 4 * dir;
+            const int32_t second_opcode = opcode_of(second.value(), dir), third_opcode = opcode_of(third.value(), dir);
+            const bool second_is_swap = (second_opcode & ~DIRECTION_BIT) == opcode_for("swap");
+            const bool third_is_swap = (third_opcode & ~DIRECTION_BIT) == opcode_for("swap");
+
+            if (second_opcode == opcode_for("load") && third_is_swap) {
+                return {Specialized::LOAD_THROUGH_LOCAL, operand,
+                        sign_extend(second.value() & OPERAND_WIDTH_MASK), next};
+            }
+            if (second_is_swap && third_opcode == opcode_for("store")) {
+                return {Specialized::STORE_THROUGH_LOCAL, operand,
+                        sign_extend(third.value() & OPERAND_WIDTH_MASK), next};
+            }
+        }
+
+        const int32_t next = static_cast<int32_t>(address) + dir;
+        switch (first_opcode) {
+            case opcode_for("load"):
+                return {Specialized::LOAD, operand, 0, next};
+            case opcode_for("store"):
+                return {Specialized::STORE, operand, 0, next};
+            case opcode_for("memswap"):
+            case INVERSE(opcode_for("memswap")):
+                return {Specialized::MEMSWAP, operand, 0, next};
+            default:
+                return {};
+        }
+    }
+
+    /**
+     * Specializes an access to a local variable at an address, executed in the given direction.
+     * A local variable updated by an instruction in between pushl and popl is combined with both.
+     */
+    [[nodiscard]] static Specialization specialize_local(const std::vector<int32_t> &program, size_t address,
+                                                         Direction dir) {
+        const auto instruction_at = [&](int64_t offset) {
+            return instruction_after(program, address, offset, dir);
+        };
+        const int32_t first = program[address], first_opcode = opcode_of(first, dir);
+        const int32_t local = sign_extend(first & OPERAND_WIDTH_MASK);
+
+        const auto update = instruction_at(1), last = instruction_at(2);
+        if (first_opcode == opcode_for("pushl") && update.has_value() && last.has_value() &&
+            opcode_of(last.value(), dir) == opcode_for("popl") &&
+            sign_extend(last.value() & OPERAND_WIDTH_MASK) == local) {
+            const int32_t next = static_cast<int32_t>(address) + 3 * dir;
+            const int32_t amount = sign_extend(update.value() & OPERAND_WIDTH_MASK);
+            switch (opcode_of(update.value(), dir)) {
+                case opcode_for("inc"):
+                    return {Specialized::ADD_LOCAL, local, amount, next};
+                case opcode_for("dec"):
+                    return {Specialized::ADD_LOCAL, local, -amount, next};
+                case opcode_for("neg"):
+                case INVERSE(opcode_for("neg")):
+                    return {Specialized::NEGATE_LOCAL, local, 0, next};
+                default:
+                    break;
+            }
+        }
+
+        const int32_t next = static_cast<int32_t>(address) + dir;
+        if (first_opcode == opcode_for("pushl")) return {Specialized::PUSH_LOCAL, local, 0, next};
+        if (first_opcode == opcode_for("popl")) return {Specialized::POP_LOCAL, local, 0, next};
+        return {};
+    }
+
+    [[nodiscard]] static std::vector<DecodedInstruction> decode(const std::vector<int32_t> &program) {
+        std::vector<DecodedInstruction> decoded(program.size());
+        for (size_t i = 0; i < program.size(); i++) {
+            if (jump_kind(program[i]) != Specialized::NONE) {
+                decoded[i].forward = fuse_jump(program, i, Forward);
+                decoded[i].backward = fuse_jump(program, i, Backward);
+            }
+        }
+        for (size_t i = 1; i < program.size(); i++) {
+            const auto address = static_cast<int32_t>(i);
+            if (decoded[i - 1].forward.kind == Specialized::NONE) {
+                decoded[i - 1].forward = fuse(program[i - 1], program[i], Forward, address + 1);
+            }
+            if (decoded[i].backward.kind == Specialized::NONE) {
+                decoded[i].backward = fuse(program[i], program[i - 1], Backward, address - 2);
+            }
+        }
+        for (size_t i = 0; i < program.size(); i++) {
+            for (const Direction dir: {Forward, Backward}) {
+                Specialization &specialization = dir == Forward ? decoded[i].forward : decoded[i].backward;
+                if (specialization.kind == Specialized::NONE) {
+                    specialization = specialize_memory(program, i, dir);
+                }
+                if (specialization.kind == Specialized::NONE) {
+                    specialization = specialize_local(program, i, dir);
+                }
+                if (specialization.kind == Specialized::NONE) {
+                    const int32_t operand = sign_extend(program[i] & OPERAND_WIDTH_MASK);
+                    specialization = {Specialized::INSTRUCTION, operand, opcode_of(program[i], dir), 0};
+                }
+            }
+        }
+        return decoded;
+    }
+
+    /**
+     * Checks 0 <= index < bound with a single comparison, given a non-negative bound.
+     */
+    [[nodiscard]] static bool is_below(int32_t index, int32_t bound) {
+        return static_cast<uint32_t>(index) < static_cast<uint32_t>(bound);
+    }
+
+    bool VM::step_specialized() {
+        if (br != 0 || static_cast<size_t>(pc) >= decoded.size()) {
+            return false;
+        }
+
+        // Registers are updated as if all instructions were executed by step.
+        const auto memory_size = static_cast<int32_t>(memory.size());
+        const Specialization &specialization = dir == Forward ? decoded[pc].forward : decoded[pc].backward;
+        switch (specialization.kind) {
+            case Specialized::PUSH_WIDE:
+                this->counter++;
+                PUSHES_VALUES(1)
+                stack[sp] = specialization.low ^ specialization.high;
+                sp += 1;
+                pc += dir;
+                this->counter++;
+                pc = specialization.next;
+                return true;
+
+            case Specialized::POP_WIDE:
+                this->counter++;
+                REQUIRES_PARAMS(1)
+                stack[sp - 1] ^= specialization.high;
+                pc += dir;
+                this->counter++;
+                sp -= 1;
+                clear(stack[sp], specialization.low);
+                pc = specialization.next;
+                return true;
+
+            case Specialized::JUMP_IF_TRUE:
+            case Specialized::JUMP_IF_FALSE:
+                if (sp < 1) {
+                    return false; // Underflow is reported by step.
+                }
+                if (stack[sp - 1] != (specialization.kind == Specialized::JUMP_IF_TRUE ? True : False)) {
+                    this->counter++;
+                    pc += dir;
+                    return true;
+                }
+            case Specialized::JUMP:
+                // The target adds the negated offset to br again, so br is 0 after both branches.
+                this->counter += 2;
+                pc = specialization.next;
+                return true;
+
+            case Specialized::PUSH_LOCAL: {
+                const int32_t local = fp + specialization.low;
+                if (!is_below(local, sp) || stack.capacity() - sp <= 1) {
+                    return false; // Errors are reported by step.
+                }
+                this->counter++;
+                swap(stack[sp], stack[local]);
+                sp += 1;
+                pc = specialization.next;
+                return true;
+            }
+
+            case Specialized::POP_LOCAL: {
+                const int32_t local = fp + specialization.low;
+                if (sp < 1 || !is_below(local, sp) || stack[local] != 0) {
+                    return false;
+                }
+                this->counter++;
+                sp -= 1;
+                swap(stack[sp], stack[local]);
+                pc = specialization.next;
+                return true;
+            }
+
+            case Specialized::ADD_LOCAL:
+            case Specialized::NEGATE_LOCAL: {
+                // The value pushl moves into the variable is restored by popl, which requires it to be 0.
+                const int32_t local = fp + specialization.low;
+                if (!is_below(local, sp) || stack.capacity() - sp <= 1 || stack[sp] != 0) {
+                    return false;
+                }
+                this->counter += 3;
+                if (specialization.kind == Specialized::ADD_LOCAL) {
+                    stack[local] += specialization.high;
+                } else {
+                    stack[local] = -stack[local];
+                }
+                pc = specialization.next;
+                return true;
+            }
+
+            case Specialized::LOAD: {
+                if (sp < 1 || stack.capacity() - sp <= 1) {
+                    return false;
+                }
+                const int32_t address = stack[sp - 1] + specialization.low;
+                if (!is_below(address, memory_size)) {
+                    return false;
+                }
+                this->counter++;
+                swap(stack[sp], memory[address]);
+                sp += 1;
+                pc = specialization.next;
+                return true;
+            }
+
+            case Specialized::STORE: {
+                if (sp < 2) {
+                    return false;
+                }
+                const int32_t address = stack[sp - 2] + specialization.low;
+                if (!is_below(address, memory_size) || memory[address] != 0) {
+                    return false;
+                }
+                this->counter++;
+                sp -= 1;
+                swap(stack[sp], memory[address]);
+                pc = specialization.next;
+                return true;
+            }
+
+            case Specialized::MEMSWAP: {
+                if (sp < 2) {
+                    return false;
+                }
+                const int32_t first = stack[sp - 1] + specialization.low, second = stack[sp - 2] + specialization.low;
+                if (!is_below(first, memory_size) || !is_below(second, memory_size)) {
+                    return false;
+                }
+                this->counter++;
+                swap(memory[first], memory[second]);
+                pc = specialization.next;
+                return true;
+            }
+
+            case Specialized::LOAD_THROUGH_LOCAL: {
+                // The value above the stack is moved into the variable by pushl and must be restored as 0 by popl.
+                const int32_t local = fp + specialization.low;
+                if (!is_below(local, sp) || stack.capacity() - sp <= 2 || stack[sp] != 0) {
+                    return false;
+                }
+                const int32_t address = stack[local] + specialization.high;
+                if (!is_below(address, memory_size)) {
+                    return false;
+                }
+                this->counter += 4;
+                stack[sp] = memory[address];
+                memory[address] = stack[sp + 1];
+                stack[sp + 1] = 0;
+                sp += 1;
+                pc = specialization.next;
+                return true;
+            }
+
+            case Specialized::STORE_THROUGH_LOCAL: {
+                // The stored value must not be the variable itself, which is swapped with it.
+                const int32_t local = fp + specialization.low;
+                if (sp < 2 || !is_below(local, sp - 1) || stack.capacity() - sp <= 1 || stack[sp] != 0) {
+                    return false;
+                }
+                const int32_t address = stack[local] + specialization.high;
+                if (!is_below(address, memory_size) || memory[address] != 0) {
+                    return false;
+                }
+                this->counter += 4;
+                sp -= 1;
+                swap(stack[sp], memory[address]);
+                pc = specialization.next;
+                return true;
+            }
+
+            default:
+                return false;
+        }
+    }
+
     void VM::run() {
         do {
-            this->step();
+            // Single instructions are the most frequent ones, so they bypass the switch of step_specialized.
+            // They are executed like step does, so a branch may be taken.
+            if (static_cast<size_t>(pc) < decoded.size()) {
+                const Specialization &instruction = dir == Forward ? decoded[pc].forward : decoded[pc].backward;
+                if (instruction.kind == Specialized::INSTRUCTION) {
+                    this->counter++;
+                    this->execute(instruction.high, instruction.low);
+                    this->step_pc();
+                    continue;
+                }
+            }
+            if (!this->step_specialized()) {
+                this->step();
+            }
         } while (this->running);
     }
 
@@ -466,13 +856,15 @@ namespace Machine {
            const int32_t pc) :
             dir(Forward), pc(pc), br(0), sp(0), fp(0),
             memory(memory_size), stack(stack_size),
-            running(false), counter(0), program(program) {
+            running(false), counter(0), program(program), decoded(decode(program)) {
         if (!memory_layout.empty()) {
-            if (memory_layout.begin()->first < 0 || (size_t) memory_layout.end()->first >= memory_size) {
-                throw out_of_memory(memory_layout.begin()->first, memory_layout.end()->first);
+            if (memory_layout.min_address() < 0 || memory_layout.end_address() > (int64_t) memory_size) {
+                throw out_of_memory(std::min(memory_layout.min_address(), 0),
+                                    static_cast<int>(memory_layout.end_address()));
             }
-            for (const auto &[address, value]: memory_layout) {
-                memory.at(address) = value;
+            for (const auto &segment: memory_layout.segments()) {
+                std::memcpy(memory.data() + segment.base_address, memory_layout.data(segment),
+                            segment.size * sizeof(int32_t));
             }
         }
     }
@@ -25,6 +25,86 @@ namespace Machine {
         return direction == Forward ? Backward : Forward;
     }
 
+    /**
+     * Kinds of instructions specialized when the program is decoded. Most of them
+     * combine several instructions of a program, which are executed with a single dispatch.
+     */
+    enum class Specialized : uint8_t {
+        NONE,
+        /**
+         * pushc followed by xorhc, pushing a full word.
+         */
+        PUSH_WIDE,
+        /**
+         * xorhc followed by popc, popping a full word.
+         */
+        POP_WIDE,
+        /**
+         * A branch together with the branch it jumps to, which ends the jump.
+         * Conditional branches are only fused with an unconditional one or one
+         * with the same condition, so the condition holds for both of them.
+         */
+        JUMP,
+        JUMP_IF_TRUE,
+        JUMP_IF_FALSE,
+        /**
+         * pushl or popl with their operand already decoded.
+         */
+        PUSH_LOCAL,
+        POP_LOCAL,
+        /**
+         * pushl n, followed by inc, dec or neg and popl n. The local variable is
+         * updated in place and never placed on the stack.
+         */
+        ADD_LOCAL,
+        NEGATE_LOCAL,
+        /**
+         * load, store or memswap with their operand already decoded.
+         */
+        LOAD,
+        STORE,
+        MEMSWAP,
+        /**
+         * pushl n; load k; swap; popl n loading from the address held by a local
+         * variable and pushl n; swap; store k; popl n storing to it. The variable is
+         * never placed on the stack, so the address is only checked once.
+         */
+        LOAD_THROUGH_LOCAL,
+        STORE_THROUGH_LOCAL,
+        /**
+         * Any other instruction, executed on its own with its opcode and operand already decoded.
+         */
+        INSTRUCTION
+    };
+
+    /**
+     * A specialized instruction. For wide loads, the low part is the sign-extended operand of
+     * pushc or popc and the high part is the value xor-ed by xorhc. For local variables, the
+     * low part is the offset to fp and the high part is the value added to the variable or the
+     * operand of the memory access. For single instructions, the low part is the operand and
+     * the high part is the opcode as executed in the direction of the specialization. Otherwise,
+     * the low part is the operand of the instruction.
+     */
+    struct Specialization {
+        Specialized kind = Specialized::NONE;
+        int32_t low = 0;
+        int32_t high = 0;
+        /**
+         * The address executed after all specialized instructions.
+         */
+        int32_t next = 0;
+    };
+
+    /**
+     * The specialized instructions starting at an address, if executed in either direction.
+     * Executing backwards, instructions are combined from the instruction at the address and
+     * the ones before it.
+     */
+    struct DecodedInstruction {
+        Specialization forward;
+        Specialization backward;
+    };
+
     struct VM {
         Direction dir;
         int32_t pc;
@@ -40,6 +120,7 @@ namespace Machine {
         size_t counter;
 
         const std::vector<int32_t> &program;
+        std::vector<DecodedInstruction> decoded;
 
         explicit VM(const std::vector<int32_t> &program,
                     const MemoryLayout &memory_layout,
@@ -47,13 +128,32 @@ namespace Machine {
                     size_t stack_size,
                     int32_t pc);
 
+        /**
+         * Executes a single instruction. This is the reference implementation for
+         * all instructions, used by the debugger and other instrumented executions.
+         */
         void step();
 
+        /**
+         * Executes the program until it stops, using the instructions decoded when the
+         * machine was created, so every instruction is dispatched only once.
+         */
         void run();
 
+        /**
+         * Executes the specialized instruction at pc, if there is one and no branch is taken.
+         * Returns whether an instruction was executed.
+         */
+        bool step_specialized();
+
         void step_pc();
 
         void step_instr();
+
+        /**
+         * Executes the instruction at pc, given its opcode in the current direction and its operand.
+         */
+        void execute(int32_t opcode, int32_t operand);
     };
 
 }
@@ -79,6 +79,38 @@ public:
     ~illegal_section_content() override = default;
 };
 
+class undefined_export : public error_message {
+public:
+    explicit undefined_export(const char *symbol) : error_message(
+            "Exported symbol '" + std::string(symbol) + "' is not defined.") {}
+
+    ~undefined_export() override = default;
+};
+
+class undefined_constant : public error_message {
+public:
+    explicit undefined_constant(const std::string &symbol) : error_message(
+            "Symbol '" + symbol + "' is not defined by a .set directive.") {}
+
+    ~undefined_constant() override = default;
+};
+
+class invalid_object_file : public error_message {
+public:
+    explicit invalid_object_file(const std::string &filename) : error_message(
+            "File " + filename + " is not a valid object file.") {}
+
+    ~invalid_object_file() override = default;
+};
+
+class invalid_json : public error_message {
+public:
+    explicit invalid_json(const std::string &filename, size_t offset, const std::string &reason) : error_message(
+            "File " + filename + " is not valid JSON at offset " + std::to_string(offset) + ": " + reason + ".") {}
+
+    ~invalid_json() override = default;
+};
+
 class start_stop_presence : public error_message {
 public:
     explicit start_stop_presence(const char *mnemonic) : error_message(
@@ -0,0 +1,352 @@
+/**
+ * Inlining of small procedures into their call sites.
+ *
+ * Procedures are recognized by the layouts used for procedures throughout
+ * the examples, where neg either follows or precedes the entry point:
+ *
+ *   f_top:  branch f_bot                 f_top:  branch f_bot
+ *   f:      call                                 neg
+ *           neg                          f:      call
+ *           (body)                               (body)
+ *   f_bot:  branch f_top                 f_bot:  branch f_top
+ *
+ * Call sites are recognized as
+ *
+ *           pushc [f - L]
+ *   L:      call                   (or uncall)
+ *           popc [L - f]
+ *
+ * where L may also be written relative to the current address.
+ *
+ * A call site is replaced by the body of the procedure, enclosed by pushc 0
+ * and popc 0 taking the place of the return offset found on the stack while
+ * the body is executed. For uncall, the body is inserted in reverse order with
+ * every instruction replaced by its inverse, which is exactly what executing
+ * it backwards does. The procedure itself is left unchanged.
+ *
+ * Relative operands (@+n) outside of inlined bodies are adjusted to refer to
+ * the same line afterwards. Call sites whose call instruction is referenced by
+ * such an operand are not inlined, since the instruction is removed.
+ */
+
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "optimizer.h"
+#include "rewrite.h"
+
+namespace Optimizer {
+
+    /**
+     * Procedures with a larger body are not inlined.
+     */
+    constexpr size_t MAXIMUM_INLINED_LINES = 32;
+
+    /**
+     * The range of lines forming the body of a procedure.
+     */
+    struct Procedure {
+        size_t begin, end;
+    };
+
+    // Symbols are interned, so they can be compared by their address.
+    using LabelIndex = std::unordered_map<const char *, size_t>;
+    using ReferenceCount = std::unordered_map<const char *, size_t>;
+
+    [[nodiscard]] static LabelIndex index_labels(const Section &code) {
+        LabelIndex labels;
+        for (size_t index = 0; index < code.size(); index++) {
+            for (StringList *list = code[index].labels; !list->isEmpty; list = list->tail) {
+                labels.emplace(list->head, index);
+            }
+        }
+        return labels;
+    }
+
+    static void count_references(Operand operand, ReferenceCount &references) {
+        for_each_symbol(operand, [&](const char *symbol) {
+            references[symbol]++;
+        });
+    }
+
+    [[nodiscard]] static ReferenceCount count_references(const Program &program) {
+        ReferenceCount references;
+        for (const Line &line: program.code) {
+            count_references(line.value.instruction.operand, references);
+        }
+        for (const Line &line: program.data) {
+            if (line.variant == LINE_WORDS) {
+                for (OperandList *list = line.value.words.data; !list->isEmpty; list = list->tail) {
+                    count_references(list->head, references);
+                }
+            } else if (line.variant == LINE_SET) {
+                count_references(line.value.setValue.memoryAddress, references);
+                count_references(line.value.setValue.value, references);
+            }
+        }
+        for (const Line &line: program.bss) {
+            if (line.variant == LINE_RESERVED) {
+                count_references(line.value.reserved.size, references);
+            }
+        }
+        return references;
+    }
+
+    [[nodiscard]] static bool has_label(const Line &line, const char *label) {
+        for (StringList *list = line.labels; !list->isEmpty; list = list->tail) {
+            if (list->head == label) return true;
+        }
+        return false;
+    }
+
+    /**
+     * Returns the symbol a branch instruction refers to, or nullptr if the line is no such branch.
+     */
+    [[nodiscard]] static const char *branch_target(const Line &line) {
+        const Operand &operand = line.value.instruction.operand;
+        if (!has_mnemonic(line, "branch") || operand.variant != PRIMITIVE_SYMBOL) return nullptr;
+        return operand.instance.primitive.value.symbol;
+    }
+
+    /**
+     * Finds the procedure entered by the call instruction at the given line, if it follows a known layout.
+     */
+    [[nodiscard]] static std::optional<Procedure> find_procedure(const Section &code, size_t entry,
+                                                                 const LabelIndex &labels) {
+        size_t top, begin;
+        if (entry >= 1 && entry + 1 < code.size() &&
+            has_mnemonic(code[entry + 1], "neg") && !has_labels(code[entry + 1])) {
+            top = entry - 1;
+            begin = entry + 2;
+        } else if (entry >= 2 && has_mnemonic(code[entry - 1], "neg") && !has_labels(code[entry - 1])) {
+            top = entry - 2;
+            begin = entry + 1;
+        } else {
+            return std::nullopt;
+        }
+
+        const char *bottom_label = branch_target(code[top]);
+        if (bottom_label == nullptr) return std::nullopt;
+        const auto bottom = labels.find(bottom_label);
+        if (bottom == labels.end() || bottom->second < begin) return std::nullopt;
+
+        const char *top_label = branch_target(code[bottom->second]);
+        if (top_label == nullptr || !has_label(code[top], top_label)) return std::nullopt;
+
+        return Procedure{begin, bottom->second};
+    }
+
+    /**
+     * Checks whether a procedure body can be copied elsewhere. Its control flow must not leave
+     * the body, which also excludes calling other procedures.
+     */
+    [[nodiscard]] static bool is_inlinable(const Section &code, const Procedure &procedure, const LabelIndex &labels) {
+        if (procedure.end - procedure.begin > MAXIMUM_INLINED_LINES) return false;
+
+        const auto within_body = [&](int64_t index) {
+            return index >= static_cast<int64_t>(procedure.begin) && index < static_cast<int64_t>(procedure.end);
+        };
+
+        for (size_t index = procedure.begin; index < procedure.end; index++) {
+            const Line &line = code[index];
+            for (const char *mnemonic: {"start", "stop", "call", "uncall"}) {
+                if (has_mnemonic(line, mnemonic)) return false;
+            }
+
+            bool is_contained = true;
+            Operand operand = line.value.instruction.operand;
+            for_each_relative(operand, [&](int32_t offset) {
+                is_contained &= within_body(static_cast<int64_t>(index) + offset);
+            });
+            if (line.value.instruction.data->operand_mode == OperandMode::RELATIVE) {
+                for_each_symbol(operand, [&](const char *symbol) {
+                    const auto label = labels.find(symbol);
+                    is_contained &= label != labels.end() && within_body(static_cast<int64_t>(label->second));
+                });
+            }
+            if (!is_contained) return false;
+        }
+        return true;
+    }
+
+    /**
+     * Checks whether a primitive operand refers to the call instruction of a call site,
+     * either using one of its labels or relative to the current address.
+     */
+    [[nodiscard]] static bool refers_to_call(const PrimitiveOperand &operand, const Line &call, int32_t relative) {
+        return (operand.variant == PRIMITIVE_RELATIVE && operand.value.relative == relative) ||
+               (operand.variant == PRIMITIVE_SYMBOL && has_label(call, operand.value.symbol));
+    }
+
+    /**
+     * Counts the relative operands referring to every line.
+     */
+    [[nodiscard]] static std::vector<size_t> count_relative_references(Section &code) {
+        const auto size = static_cast<int64_t>(code.size());
+        std::vector<size_t> references(code.size());
+        for (int64_t index = 0; index < size; index++) {
+            for_each_relative(code[index].value.instruction.operand, [&](int32_t offset) {
+                const int64_t target = index + offset;
+                if (target >= 0 && target < size) references[target]++;
+            });
+        }
+        return references;
+    }
+
+    /**
+     * Returns the procedure called by the call site starting at the given line, if there is one.
+     */
+    [[nodiscard]] static const Procedure *find_call_site(const Section &code, size_t index,
+                                                         const std::unordered_map<const char *, Procedure> &procedures,
+                                                         const ReferenceCount &references,
+                                                         const std::vector<size_t> &relative_references) {
+        if (index + 2 >= code.size()) return nullptr;
+        const Line &enter = code[index], &call = code[index + 1], &leave = code[index + 2];
+        if (!has_mnemonic(enter, "pushc") || !has_mnemonic(leave, "popc") ||
+            !(has_mnemonic(call, "call") || has_mnemonic(call, "uncall"))) {
+            return nullptr;
+        }
+
+        const Operand &offset = enter.value.instruction.operand, &cleared = leave.value.instruction.operand;
+        if (offset.variant != COMPLEX_SUB || cleared.variant != COMPLEX_SUB ||
+            offset.instance.complex.lhs.variant != PRIMITIVE_SYMBOL ||
+            cleared.instance.complex.rhs.variant != PRIMITIVE_SYMBOL ||
+            offset.instance.complex.lhs.value.symbol != cleared.instance.complex.rhs.value.symbol ||
+            !refers_to_call(offset.instance.complex.rhs, call, 1) ||
+            !refers_to_call(cleared.instance.complex.lhs, call, -1)) {
+            return nullptr;
+        }
+
+        // Labels of the call instruction are removed, so they must not be referenced anywhere else.
+        for (StringList *list = call.labels; !list->isEmpty; list = list->tail) {
+            size_t local_references = 0;
+            if (offset.instance.complex.rhs.variant == PRIMITIVE_SYMBOL) local_references++;
+            if (cleared.instance.complex.lhs.variant == PRIMITIVE_SYMBOL) local_references++;
+            const auto count = references.find(list->head);
+            if (count != references.end() && count->second > local_references) return nullptr;
+        }
+
+        // The call instruction is removed, so it must not be referenced relative to another line either.
+        size_t local_relative_references = 0;
+        if (offset.instance.complex.rhs.variant == PRIMITIVE_RELATIVE) local_relative_references++;
+        if (cleared.instance.complex.lhs.variant == PRIMITIVE_RELATIVE) local_relative_references++;
+        if (relative_references[index + 1] > local_relative_references) return nullptr;
+
+        const auto procedure = procedures.find(offset.instance.complex.lhs.value.symbol);
+        return procedure == procedures.end() ? nullptr : &procedure->second;
+    }
+
+    /**
+     * Appends a copy of a procedure body, renaming all labels defined in it.
+     * If the copy is inverted, it executes the body backwards.
+     */
+    static void append_body(Section &output, const Section &code, const Procedure &procedure,
+                            bool is_inverted, size_t site_number) {
+        std::unordered_map<const char *, const char *> renamed;
+        for (size_t index = procedure.begin; index < procedure.end; index++) {
+            for (StringList *list = code[index].labels; !list->isEmpty; list = list->tail) {
+                const std::string name = std::string(list->head) + "@" + std::to_string(site_number);
+                renamed.emplace(list->head, internSymbol(name.c_str(), name.size()));
+            }
+        }
+
+        for (size_t i = procedure.begin; i < procedure.end; i++) {
+            Line line = code[is_inverted ? procedure.end - 1 - (i - procedure.begin) : i];
+            Instruction &instruction = line.value.instruction;
+
+            StringList *labels = emptyStringList();
+            for (StringList *list = line.labels; !list->isEmpty; list = list->tail) {
+                labels = prependString(const_cast<char *>(renamed.at(list->head)), labels);
+            }
+            line.labels = labels;
+
+            for_each_symbol(instruction.operand, [&](const char *&symbol) {
+                const auto name = renamed.find(symbol);
+                if (name != renamed.end()) symbol = name->second;
+            });
+
+            if (is_inverted) {
+                if (!is_self_inverse(*instruction.data)) {
+                    instruction.is_forward = !instruction.is_forward;
+                    instruction.data = &InstructionData::get(instruction.offset, instruction.is_forward);
+                }
+                for_each_relative(instruction.operand, [](int32_t &offset) {
+                    offset = -offset;
+                });
+            }
+            output.push_back(line);
+        }
+    }
+
+    size_t inline_procedures(Program &program) {
+        Section &code = program.code;
+        if (!contains_only_instructions(code)) return 0;
+
+        const LabelIndex labels = index_labels(code);
+        const ReferenceCount references = count_references(program);
+        const std::vector<size_t> relative_references = count_relative_references(code);
+
+        std::unordered_map<const char *, Procedure> procedures;
+        for (size_t index = 0; index < code.size(); index++) {
+            if (!has_mnemonic(code[index], "call") || !has_labels(code[index])) continue;
+
+            const std::optional<Procedure> procedure = find_procedure(code, index, labels);
+            if (procedure.has_value() && is_inlinable(code, procedure.value(), labels)) {
+                for (StringList *list = code[index].labels; !list->isEmpty; list = list->tail) {
+                    procedures.emplace(list->head, procedure.value());
+                }
+            }
+        }
+        if (procedures.empty()) return 0;
+
+        Section inlined;
+        inlined.reserve(code.size());
+        // New position of every line. The removed call instruction takes the position of the inlined body.
+        std::vector<int64_t> position(code.size() + 1);
+        // Lines whose relative operands are adjusted, given by their index in the original and the inlined code.
+        std::vector<std::pair<size_t, size_t>> copied;
+        size_t site_count = 0;
+        for (size_t index = 0; index < code.size(); index++) {
+            position[index] = static_cast<int64_t>(inlined.size());
+            const Procedure *procedure = find_call_site(code, index, procedures, references, relative_references);
+            if (procedure == nullptr) {
+                copied.emplace_back(index, inlined.size());
+                inlined.push_back(code[index]);
+                continue;
+            }
+
+            // The return offset is replaced by 0, keeping all frame offsets of the body intact.
+            Line enter = code[index], leave = code[index + 2];
+            enter.value.instruction.operand = mkPrimitive(mkConstant(0));
+            leave.value.instruction.operand = mkPrimitive(mkConstant(0));
+
+            inlined.push_back(enter);
+            position[index + 1] = static_cast<int64_t>(inlined.size());
+            append_body(inlined, code, *procedure, has_mnemonic(code[index + 1], "uncall"), ++site_count);
+            position[index + 2] = static_cast<int64_t>(inlined.size());
+            inlined.push_back(leave);
+            index += 2;
+        }
+        if (site_count == 0) return 0;
+
+        // Positions outside of the code are moved by all lines inserted before them.
+        const auto size = static_cast<int64_t>(code.size());
+        position[size] = static_cast<int64_t>(inlined.size());
+        const auto new_position = [&](int64_t index) -> int64_t {
+            if (index < 0) return index;
+            if (index > size) return position[size] + (index - size);
+            return position[index];
+        };
+        for (const auto &[original, index]: copied) {
+            const auto self = static_cast<int64_t>(original);
+            for_each_relative(inlined[index].value.instruction.operand, [&](int32_t &offset) {
+                offset = static_cast<int32_t>(new_position(self + offset) - new_position(self));
+            });
+        }
+
+        code = std::move(inlined);
+        return site_count;
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+/**
+ * This header provides optimizations on the syntax of a program, which are
+ * applied after parsing and before the program is assembled.
+ *
+ * Since optimizations work on lines instead of translated instructions, the
+ * assembler recomputes every branch offset and every operand depending on
+ * labels or the current address (@) for the optimized program.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "syntax/syntax.h"
+
+namespace Optimizer {
+
+    /**
+     * A constant defined by .set and the value replacing the one given in the program.
+     */
+    struct ConstantOverride {
+        std::string symbol;
+        int32_t value;
+        /**
+         * Whether the constant was defined by any program the override was applied to.
+         */
+        bool is_applied = false;
+    };
+
+    /**
+     * Specializes a program by replacing the values of constants defined with .set.
+     * Overrides for constants the program does not define are left unapplied.
+     */
+    void override_constants(Program &program, std::vector<ConstantOverride> &overrides);
+
+    /**
+     * Parses an override given as SYMBOL=VALUE, like it is written on the command line.
+     * Returns false if the definition is malformed or VALUE is no 32-bit integer.
+     */
+    bool parse_override(const char *definition, ConstantOverride &result);
+
+    /**
+     * Removes instructions without effect from the code section of a program.
+     *
+     * Every nop instruction is removed, as is every instruction immediately
+     * followed by its inverse with the same operand (for example pushc x; popc x,
+     * swap; swap or inc a; dec a), if executing the first instruction cannot fail
+     * because of the values it operates on. Removing a pair may expose another
+     * one, so nested pairs are removed entirely.
+     *
+     * Constants are propagated through runs of instructions only computing with
+     * values pushed by the run, like pushc, inc, dec, neg, add, sub, xor, dup,
+     * swap, cmpush or arpush. A run ends at a labeled line, a branch or any other
+     * instruction depending on unknown values, and is replaced by pushing its
+     * resulting values if that is shorter. Symbols defined by .set are constants,
+     * so overriding them specializes the program. An inc, dec or neg directly
+     * followed by popc is folded into the popc.
+     *
+     * Lines carrying labels or referenced by a relative operand (@+n) are never
+     * removed. Relative operands are adjusted to refer to the same line afterwards.
+     *
+     * @return The number of removed instructions.
+     */
+    size_t eliminate_redundant_instructions(Program &program);
+
+    /**
+     * Replaces calls and uncalls of small procedures with a copy of the procedure body.
+     *
+     * Only procedures following the usual layout (see inline.cpp) are inlined, if
+     * their body does not call other procedures and its branches stay within the body.
+     * Labels defined in the body are renamed for every copy. Uncalls are replaced by
+     * the inverted body, which executes the procedure backwards. Relative operands
+     * outside of the inlined bodies are adjusted to refer to the same line afterwards.
+     *
+     * @return The number of inlined call sites.
+     */
+    size_t inline_procedures(Program &program);
+
+}
@@ -0,0 +1,455 @@
+
+#include <cstring>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include "optimizer.h"
+#include "rewrite.h"
+#include "assembler/assembler.h"
+#include "messages/error.h"
+
+namespace Optimizer {
+
+    /**
+     * Instructions that can only fail because the stack holds too few values or has no room
+     * for another one, but never because of the values, addresses or operands they operate on.
+     * If one of these is immediately followed by its inverse, the inverse restores the previous
+     * machine state. This holds in both directions of execution, so removing such a pair can
+     * only hide a stack underflow or overflow.
+     *
+     * Control flow instructions, instructions clearing a value, division, memory accesses and
+     * accesses to the stack frame are excluded.
+     */
+    static constexpr std::string_view CANCELLABLE_INSTRUCTIONS[] = {
+            "pushc", "dup", "swap", "bury", "dig",
+            "pushtrue", "pushfalse", "cmpusheq", "cmpushne", "cmpushlt", "cmpushle",
+            "inc", "dec", "neg", "add", "sub", "xor", "shl", "shr",
+            "arpushadd", "arpushsub", "arpushmul", "arpushand", "arpushor",
+            "xorhc",
+    };
+
+    [[nodiscard]] static bool is_cancellable(const InstructionData &instruction) {
+        for (std::string_view mnemonic: CANCELLABLE_INSTRUCTIONS) {
+            if (mnemonic == instruction.fw_mnemonic) return true;
+        }
+        return false;
+    }
+
+    // Symbols are interned, so they can be compared by their address.
+    using Constants = std::unordered_map<const char *, int32_t>;
+
+    /**
+     * Collects all symbols defined as constants by a .set directive.
+     */
+    [[nodiscard]] static Constants collect_constants(const Program &program) {
+        Constants constants;
+        for (const Line &line: program.data) {
+            if (line.variant != LINE_SET || line.value.setValue.memoryAddress.variant != PRIMITIVE_SYMBOL) continue;
+            try {
+                constants.emplace(line.value.setValue.memoryAddress.instance.primitive.value.symbol,
+                                  Assembler::restrict_eval(line.value.setValue.value));
+            } catch (error_message &) {
+                // Reported by the assembler.
+            }
+        }
+        return constants;
+    }
+
+    [[nodiscard]] static std::optional<int32_t> constant_value(const PrimitiveOperand &operand,
+                                                               const Constants &constants) {
+        switch (operand.variant) {
+            case PRIMITIVE_CONSTANT:
+                return operand.value.constant;
+            case PRIMITIVE_SYMBOL: {
+                const auto constant = constants.find(operand.value.symbol);
+                if (constant == constants.end()) return std::nullopt;
+                return constant->second;
+            }
+            default:
+                return std::nullopt;
+        }
+    }
+
+    /**
+     * Evaluates an operand, if it does not depend on labels or the current address.
+     */
+    [[nodiscard]] static std::optional<int32_t> constant_value(const Operand &operand, const Constants &constants) {
+        switch (operand.variant) {
+            case PRIMITIVE_SYMBOL:
+            case PRIMITIVE_CONSTANT:
+            case PRIMITIVE_RELATIVE:
+                return constant_value(operand.instance.primitive, constants);
+            case COMPLEX_ADD:
+            case COMPLEX_SUB: {
+                const auto lhs = constant_value(operand.instance.complex.lhs, constants);
+                const auto rhs = constant_value(operand.instance.complex.rhs, constants);
+                if (!lhs.has_value() || !rhs.has_value()) return std::nullopt;
+                return operand.variant == COMPLEX_ADD ? lhs.value() + rhs.value() : lhs.value() - rhs.value();
+            }
+            default:
+                return std::nullopt;
+        }
+    }
+
+    /**
+     * Compares primitive operands by their syntax. Relative operands never compare equal,
+     * since their value depends on the position of the instruction they belong to.
+     */
+    [[nodiscard]] static bool same_primitive(const PrimitiveOperand &lhs, const PrimitiveOperand &rhs) {
+        if (lhs.variant != rhs.variant) return false;
+        switch (lhs.variant) {
+            case PRIMITIVE_SYMBOL:
+                return lhs.value.symbol == rhs.value.symbol; // Symbols are interned.
+            case PRIMITIVE_CONSTANT:
+                return lhs.value.constant == rhs.value.constant;
+            default:
+                return false;
+        }
+    }
+
+    [[nodiscard]] static bool same_operand(const Operand &lhs, const Operand &rhs, const Constants &constants) {
+        const auto lhs_value = constant_value(lhs, constants), rhs_value = constant_value(rhs, constants);
+        if (lhs_value.has_value() && rhs_value.has_value()) return lhs_value == rhs_value;
+
+        if (lhs.variant != rhs.variant) return false;
+        switch (lhs.variant) {
+            case NO_OPERAND:
+                return true;
+            case PRIMITIVE_SYMBOL:
+            case PRIMITIVE_CONSTANT:
+            case PRIMITIVE_RELATIVE:
+                return same_primitive(lhs.instance.primitive, rhs.instance.primitive);
+            case COMPLEX_ADD:
+            case COMPLEX_SUB:
+                return same_primitive(lhs.instance.complex.lhs, rhs.instance.complex.lhs) &&
+                       same_primitive(lhs.instance.complex.rhs, rhs.instance.complex.rhs);
+            default:
+                return false;
+        }
+    }
+
+    /**
+     * Checks whether executing the first and then the second instruction has no effect.
+     */
+    [[nodiscard]] static bool cancels(const Line &first, const Line &second, const Constants &constants) {
+        const InstructionData &first_data = *first.value.instruction.data;
+        const InstructionData &second_data = *second.value.instruction.data;
+
+        const bool is_inverse = second_data.binary == INVERSE(first_data.binary) ||
+                                (second_data.binary == first_data.binary && is_self_inverse(first_data));
+        return is_inverse && is_cancellable(first_data) &&
+               same_operand(first.value.instruction.operand, second.value.instruction.operand, constants);
+    }
+
+    /**
+     * Checks whether a value is represented exactly by the operand of an instruction.
+     */
+    [[nodiscard]] static bool fits_operand(int64_t value) {
+        return value >= -(int64_t{1} << (OPERAND_WIDTH - 1)) && value < (int64_t{1} << (OPERAND_WIDTH - 1));
+    }
+
+    [[nodiscard]] static std::optional<int32_t> operand_value(const Line &line, const Constants &constants) {
+        const auto value = constant_value(line.value.instruction.operand, constants);
+        if (!value.has_value() || !fits_operand(value.value())) return std::nullopt;
+        return value;
+    }
+
+    /**
+     * Computes the value a unary instruction (inc, dec or neg) leaves on the stack for a given value.
+     */
+    [[nodiscard]] static std::optional<int64_t> apply_unary(const Line &line, int64_t value, const Constants &constants) {
+        if (has_mnemonic(line, "neg")) return -value;
+
+        const auto operand = operand_value(line, constants);
+        if (!operand.has_value()) return std::nullopt;
+        if (has_mnemonic(line, "inc")) return value + operand.value();
+        if (has_mnemonic(line, "dec")) return value - operand.value();
+        return std::nullopt;
+    }
+
+    /**
+     * Computes the value a binary instruction (add, sub or xor) leaves on top of the stack.
+     */
+    [[nodiscard]] static std::optional<int64_t> apply_binary(const Line &line, int64_t top, int64_t second) {
+        if (has_mnemonic(line, "add")) return top + second;
+        if (has_mnemonic(line, "sub")) return top - second;
+        if (has_mnemonic(line, "xor")) return top ^ second;
+        return std::nullopt;
+    }
+
+    /**
+     * A line kept in the optimized program, which may have been changed by constant folding.
+     */
+    struct KeptLine {
+        size_t index;
+        bool pinned;
+        Line line;
+    };
+
+    [[nodiscard]] static Line with_constant(Line line, int32_t value) {
+        line.value.instruction.operand = mkPrimitive(mkConstant(value));
+        return line;
+    }
+
+    /**
+     * Folds a line clearing a constant into the topmost kept line, if that line only changes the
+     * value by a constant. Returns whether the line was folded and can be dropped. Supported are
+     *   inc b; popc a   => popc (a - b)       and likewise dec and neg.
+     */
+    static bool fold_constants(std::vector<KeptLine> &kept, const Line &line, const Constants &constants) {
+        if (kept.empty() || kept.back().pinned || !has_mnemonic(line, "popc")) return false;
+        Line &top = kept.back().line;
+
+        const auto popped = operand_value(line, constants);
+        if (!popped.has_value()) return false;
+
+        // Applying the inverse to the expected value yields the value expected before top.
+        Line inverse = top;
+        if (has_mnemonic(top, "inc") || has_mnemonic(top, "dec")) {
+            inverse.value.instruction.data = &InstructionData::get(top.value.instruction.offset,
+                                                                   has_mnemonic(top, "dec"));
+        }
+        const auto result = apply_unary(inverse, popped.value(), constants);
+        if (!result.has_value() || !fits_operand(result.value())) return false;
+
+        top = with_constant(line, static_cast<int32_t>(result.value()));
+        return true;
+    }
+
+    static constexpr int32_t TRUE_VALUE = -1;
+    static constexpr int32_t FALSE_VALUE = 1;
+
+    /**
+     * Truncates a value to a word, like the machine does on overflow.
+     */
+    [[nodiscard]] static int32_t wrap(int64_t value) {
+        return static_cast<int32_t>(static_cast<uint32_t>(value));
+    }
+
+    /**
+     * Evaluates the operand of an instruction to the value the machine sees, if it is constant.
+     */
+    [[nodiscard]] static std::optional<int32_t> machine_operand(const Line &line, const Constants &constants) {
+        const auto value = constant_value(line.value.instruction.operand, constants);
+        if (!value.has_value()) return std::nullopt;
+        return sign_extend(operand_low_value(value.value()));
+    }
+
+    /**
+     * Values known to be on top of the stack, since the unpinned lines pushing them only
+     * combined constants. These lines are held back until a line needs a value that is not known.
+     */
+    struct KnownValues {
+        /**
+         * The known values, from the lowest to the topmost one.
+         */
+        std::vector<int32_t> values;
+        /**
+         * The indices of all lines held back.
+         */
+        std::vector<size_t> lines;
+    };
+
+    /**
+     * Computes the effect of a line on the known values. Returns false and leaves the values
+     * unchanged if the line is not supported or depends on values that are not known.
+     *
+     * Supported are pushing constants and booleans, xorhc, inc, dec and neg, the binary
+     * operations add, sub and xor, cmpush and arpush without division, the stack operations
+     * dup, swap, bury and dig, and clearing a known value with popc, poptrue or popfalse.
+     */
+    [[nodiscard]] static bool propagate(std::vector<int32_t> &values, const Line &line, const Constants &constants) {
+        const size_t count = values.size();
+        const auto top = [&](size_t depth) -> int32_t & { return values[count - 1 - depth]; };
+
+        if (has_mnemonic(line, "pushc")) {
+            const auto operand = machine_operand(line, constants);
+            if (!operand.has_value()) return false;
+            values.push_back(operand.value());
+            return true;
+        }
+        if (has_mnemonic(line, "pushtrue") || has_mnemonic(line, "pushfalse")) {
+            values.push_back(has_mnemonic(line, "pushtrue") ? TRUE_VALUE : FALSE_VALUE);
+            return true;
+        }
+
+        if (count >= 1) {
+            if (has_mnemonic(line, "popc") || has_mnemonic(line, "poptrue") || has_mnemonic(line, "popfalse")) {
+                std::optional<int32_t> expected = has_mnemonic(line, "poptrue") ? TRUE_VALUE : FALSE_VALUE;
+                if (has_mnemonic(line, "popc")) expected = machine_operand(line, constants);
+                // A different value fails at runtime, which has to be kept.
+                if (expected != top(0)) return false;
+                values.pop_back();
+                return true;
+            }
+            if (has_mnemonic(line, "dup")) {
+                values.push_back(top(0));
+                return true;
+            }
+            if (has_mnemonic(line, "neg")) {
+                top(0) = wrap(-int64_t{top(0)});
+                return true;
+            }
+            if (has_mnemonic(line, "inc") || has_mnemonic(line, "dec") || has_mnemonic(line, "xorhc")) {
+                const auto operand = constant_value(line.value.instruction.operand, constants);
+                if (!operand.has_value()) return false;
+                if (has_mnemonic(line, "xorhc")) {
+                    const auto higher_bits = static_cast<uint32_t>(operand_high_value(operand.value()) & OPCODE_WIDTH_MASK);
+                    top(0) ^= static_cast<int32_t>(higher_bits << (OPERAND_WIDTH - 1));
+                } else {
+                    const int64_t change = sign_extend(operand_low_value(operand.value()));
+                    top(0) = wrap(top(0) + (has_mnemonic(line, "inc") ? change : -change));
+                }
+                return true;
+            }
+        }
+
+        if (count >= 2) {
+            const int64_t first = top(0), second = top(1);
+            if (has_mnemonic(line, "swap")) {
+                std::swap(top(0), top(1));
+                return true;
+            }
+
+            const auto result = apply_binary(line, first, second);
+            if (result.has_value()) {
+                top(0) = wrap(result.value());
+                return true;
+            }
+
+            std::optional<int64_t> pushed;
+            if (has_mnemonic(line, "cmpusheq")) pushed = first == second ? TRUE_VALUE : FALSE_VALUE;
+            if (has_mnemonic(line, "cmpushne")) pushed = first != second ? TRUE_VALUE : FALSE_VALUE;
+            if (has_mnemonic(line, "cmpushlt")) pushed = first < second ? TRUE_VALUE : FALSE_VALUE;
+            if (has_mnemonic(line, "cmpushle")) pushed = first <= second ? TRUE_VALUE : FALSE_VALUE;
+            if (has_mnemonic(line, "arpushadd")) pushed = first + second;
+            if (has_mnemonic(line, "arpushsub")) pushed = first - second;
+            if (has_mnemonic(line, "arpushmul")) pushed = first * second;
+            if (has_mnemonic(line, "arpushand")) pushed = first & second;
+            if (has_mnemonic(line, "arpushor")) pushed = first | second;
+            if (pushed.has_value()) {
+                values.push_back(wrap(pushed.value()));
+                return true;
+            }
+        }
+
+        if (count >= 3 && (has_mnemonic(line, "bury") || has_mnemonic(line, "dig"))) {
+            const int32_t first = top(0), second = top(1), third = top(2);
+            if (has_mnemonic(line, "bury")) {
+                top(2) = first, top(1) = third, top(0) = second;
+            } else {
+                top(0) = third, top(1) = first, top(2) = second;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    [[nodiscard]] static Line instruction_line(const Line &origin, const char *mnemonic, int32_t operand) {
+        size_t offset;
+        bool is_forward;
+        lookupMnemonic(mnemonic, strlen(mnemonic), &offset, &is_forward);
+
+        Line line = origin;
+        line.value.instruction = mkInstruction(offset, is_forward, mkPrimitive(mkConstant(operand))).value.instruction;
+        line.value.instruction.data = &InstructionData::get(offset, is_forward);
+        return line;
+    }
+
+    /**
+     * Emits the known values as kept lines, as pushc v or as pushc v; xorhc v for values exceeding
+     * an operand. The emitted lines take the places of the first lines held back. If this does not
+     * save any line, the held back lines are kept unchanged instead.
+     */
+    static void flush(KnownValues &known, std::vector<KeptLine> &kept, const Section &code) {
+        size_t needed = 0;
+        for (int32_t value: known.values) needed += fits_operand(value) ? 1 : 2;
+
+        if (needed >= known.lines.size()) {
+            for (size_t index: known.lines) kept.push_back({index, false, code[index]});
+        } else {
+            auto index = known.lines.begin();
+            for (int32_t value: known.values) {
+                const Line &origin = code[*index];
+                kept.push_back({*index++, false, instruction_line(origin, "pushc", value)});
+                if (!fits_operand(value)) {
+                    kept.push_back({*index++, false, instruction_line(origin, "xorhc", value)});
+                }
+            }
+        }
+        known.values.clear();
+        known.lines.clear();
+    }
+
+    size_t eliminate_redundant_instructions(Program &program) {
+        Section &code = program.code;
+        const int64_t size = static_cast<int64_t>(code.size());
+        if (!contains_only_instructions(code)) return 0;
+
+        const Constants constants = collect_constants(program);
+
+        // Labeled lines and lines referenced by relative operands must be kept.
+        std::vector<bool> pinned(code.size());
+        for (int64_t index = 0; index < size; index++) {
+            if (has_labels(code[index])) pinned[index] = true;
+            for_each_relative(code[index].value.instruction.operand, [&](int32_t offset) {
+                const int64_t target = index + offset;
+                if (target >= 0 && target < size) pinned[target] = true;
+            });
+        }
+
+        // Kept lines are collected like a stack, so removing a pair exposes the enclosing one.
+        std::vector<KeptLine> kept;
+        kept.reserve(code.size());
+        KnownValues known;
+        for (size_t index = 0; index < code.size(); index++) {
+            const Line &line = code[index];
+            if (!pinned[index]) {
+                if (has_mnemonic(line, "nop")) continue;
+                if (propagate(known.values, line, constants)) {
+                    known.lines.push_back(index);
+                    continue;
+                }
+            }
+            flush(known, kept, code);
+
+            if (!pinned[index]) {
+                if (!kept.empty() && !kept.back().pinned && cancels(kept.back().line, line, constants)) {
+                    kept.pop_back();
+                    continue;
+                }
+                if (fold_constants(kept, line, constants)) continue;
+            }
+            kept.push_back({index, pinned[index], line});
+        }
+        flush(known, kept, code);
+
+        const size_t removed = code.size() - kept.size();
+        if (removed == 0) return 0;
+
+        // New position of every line. Positions outside of the code are moved by all removed lines before them.
+        std::vector<int64_t> position(code.size() + 1);
+        for (size_t i = 0, next = 0; i <= code.size(); i++) {
+            position[i] = next;
+            if (next < kept.size() && kept[next].index == i) next++;
+        }
+        const auto new_position = [&](int64_t index) -> int64_t {
+            if (index < 0) return index;
+            if (index > size) return position[size] + (index - size);
+            return position[index];
+        };
+
+        Section optimized;
+        optimized.reserve(kept.size());
+        for (KeptLine &kept_line: kept) {
+            Line &line = kept_line.line;
+            for_each_relative(line.value.instruction.operand, [&](int32_t &offset) {
+                const int64_t self = static_cast<int64_t>(kept_line.index);
+                offset = static_cast<int32_t>(new_position(self + offset) - new_position(self));
+            });
+            optimized.push_back(line);
+        }
+        code = std::move(optimized);
+        return removed;
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+/**
+ * Helpers shared by all optimizations rewriting the lines of a program.
+ */
+
+#include <cstring>
+#include "syntax/instructions.h"
+#include "syntax/syntax.h"
+
+namespace Optimizer {
+
+    /**
+     * Checks whether a line holds the instruction with the given mnemonic, as it is written in the source.
+     */
+    [[nodiscard]] inline bool has_mnemonic(const Line &line, const char *mnemonic) {
+        return strcmp(line.value.instruction.data->fw_mnemonic, mnemonic) == 0;
+    }
+
+    [[nodiscard]] inline bool has_labels(const Line &line) {
+        return !line.labels->isEmpty;
+    }
+
+    [[nodiscard]] inline bool is_self_inverse(const InstructionData &instruction) {
+        return strcmp(instruction.fw_mnemonic, instruction.bw_mnemonic) == 0;
+    }
+
+    template<typename Action>
+    void for_each_relative(PrimitiveOperand &operand, Action action) {
+        if (operand.variant == PRIMITIVE_RELATIVE) action(operand.value.relative);
+    }
+
+    /**
+     * Runs an action for the offset of every relative operand (@+n) within an operand.
+     */
+    template<typename Action>
+    void for_each_relative(Operand &operand, Action action) {
+        switch (operand.variant) {
+            case PRIMITIVE_RELATIVE:
+                for_each_relative(operand.instance.primitive, action);
+                break;
+            case COMPLEX_ADD:
+            case COMPLEX_SUB:
+                for_each_relative(operand.instance.complex.lhs, action);
+                for_each_relative(operand.instance.complex.rhs, action);
+                break;
+            default:
+                break;
+        }
+    }
+
+    template<typename Action>
+    void for_each_symbol(PrimitiveOperand &operand, Action action) {
+        if (operand.variant == PRIMITIVE_SYMBOL) action(operand.value.symbol);
+    }
+
+    /**
+     * Runs an action for every symbol referenced by an operand.
+     */
+    template<typename Action>
+    void for_each_symbol(Operand &operand, Action action) {
+        switch (operand.variant) {
+            case PRIMITIVE_SYMBOL:
+                for_each_symbol(operand.instance.primitive, action);
+                break;
+            case COMPLEX_ADD:
+            case COMPLEX_SUB:
+                for_each_symbol(operand.instance.complex.lhs, action);
+                for_each_symbol(operand.instance.complex.rhs, action);
+                break;
+            default:
+                break;
+        }
+    }
+
+    /**
+     * Checks whether all lines of a section are instructions. Other lines are reported by the assembler,
+     * so optimizations leave sections containing them unchanged.
+     */
+    [[nodiscard]] inline bool contains_only_instructions(const Section &section) {
+        for (const Line &line: section) {
+            if (line.variant != LINE_INSTRUCTION) return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,43 @@
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include "optimizer.h"
+
+namespace Optimizer {
+
+    void override_constants(Program &program, std::vector<ConstantOverride> &overrides) {
+        for (ConstantOverride &override: overrides) {
+            // Symbols are interned, so a symbol never seen cannot be defined by the program.
+            const char *symbol = findSymbol(override.symbol.c_str());
+            if (symbol == nullptr) continue;
+
+            for (Line &line: program.data) {
+                SetValue &set = line.value.setValue;
+                if (line.variant == LINE_SET && set.memoryAddress.variant == PRIMITIVE_SYMBOL &&
+                    set.memoryAddress.instance.primitive.value.symbol == symbol) {
+                    set.value = mkPrimitive(mkConstant(override.value));
+                    override.is_applied = true;
+                }
+            }
+        }
+    }
+
+    bool parse_override(const char *definition, ConstantOverride &result) {
+        const char *separator = strchr(definition, '=');
+        if (separator == nullptr || separator == definition || separator[1] == '\0') {
+            return false;
+        }
+
+        char *end;
+        errno = 0;
+        const long value = strtol(separator + 1, &end, 10);
+        if (*end != '\0' || errno != 0 || value < INT32_MIN || value > INT32_MAX) {
+            return false;
+        }
+
+        result.symbol = std::string(definition, separator);
+        result.value = static_cast<int32_t>(value);
+        return true;
+    }
+}
@@ -0,0 +1,170 @@
+
+#include <cstring>
+#include <iostream>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "counters.h"
+
+namespace Perf {
+
+    struct CounterDescription {
+        const char *name;
+        const char *key; // Used in JSON documents.
+        uint32_t type;
+        uint64_t config;
+    };
+
+    static constexpr uint64_t cache_event(uint64_t cache, uint64_t operation, uint64_t result) {
+        return cache | (operation << 8) | (result << 16);
+    }
+
+    static constexpr CounterDescription COUNTER_DESCRIPTIONS[COUNTER_AMOUNT] = {
+            {"cycles",          "cycles",          PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {"instructions",    "instructions",    PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {"branch misses",   "branch_misses",   PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            {"L1d read misses", "l1d_read_misses", PERF_TYPE_HW_CACHE,
+                    cache_event(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+            {"LLC misses",      "llc_misses",      PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    };
+
+    static int open_counter(const CounterDescription &description) {
+        perf_event_attr attributes{};
+        attributes.size = sizeof(attributes);
+        attributes.type = description.type;
+        attributes.config = description.config;
+        attributes.disabled = 1;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        return static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+    }
+
+    Counters::Counters() : descriptors(), errors() {
+        for (int counter = 0; counter < COUNTER_AMOUNT; counter++) {
+            descriptors[counter] = open_counter(COUNTER_DESCRIPTIONS[counter]);
+            if (descriptors[counter] < 0) {
+                errors[counter] = strerror(errno);
+            }
+        }
+    }
+
+    Counters::~Counters() {
+        for (const int descriptor: descriptors) {
+            if (descriptor >= 0) close(descriptor);
+        }
+    }
+
+    void Counters::start() noexcept {
+        for (const int descriptor: descriptors) {
+            if (descriptor >= 0) {
+                ioctl(descriptor, PERF_EVENT_IOC_RESET, 0);
+                ioctl(descriptor, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+
+    void Counters::stop() noexcept {
+        for (const int descriptor: descriptors) {
+            if (descriptor >= 0) ioctl(descriptor, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+
+    std::optional<uint64_t> Counters::value(Counter counter) const noexcept {
+        struct {
+            uint64_t value;
+            uint64_t time_enabled;
+            uint64_t time_running;
+        } result{};
+
+        if (descriptors[counter] < 0 ||
+            read(descriptors[counter], &result, sizeof(result)) != sizeof(result) ||
+            result.time_running == 0) {
+            return {};
+        }
+
+        if (result.time_running < result.time_enabled) { // Counter was multiplexed, extrapolate.
+            return static_cast<uint64_t>(static_cast<double>(result.value) *
+                                         static_cast<double>(result.time_enabled) /
+                                         static_cast<double>(result.time_running));
+        }
+        return result.value;
+    }
+
+
+    static void report_ratio(const char *description, std::optional<uint64_t> numerator, double denominator) {
+        if (numerator.has_value() && denominator > 0) {
+            std::cerr << "  " << static_cast<double>(numerator.value()) / denominator << " " << description << "\n";
+        }
+    }
+
+    void report_counters(const Counters &counters, size_t executed_instructions) noexcept {
+        bool any_available = false;
+
+        std::cerr << "Hardware counters:\n";
+        for (int counter = 0; counter < COUNTER_AMOUNT; counter++) {
+            const auto value = counters.value(static_cast<Counter>(counter));
+            std::cerr << "  " << COUNTER_DESCRIPTIONS[counter].name << ": ";
+            if (value.has_value()) {
+                std::cerr << value.value() << "\n";
+                any_available = true;
+            } else {
+                const std::string &error = counters.error(static_cast<Counter>(counter));
+                std::cerr << "unavailable" << (error.empty() ? "" : " (" + error + ")") << "\n";
+            }
+        }
+
+        if (!any_available) {
+            std::cerr << "  No counter is available. Access may be restricted by /proc/sys/kernel/perf_event_paranoid.\n";
+        } else {
+            const auto vm_instructions = static_cast<double>(executed_instructions);
+            const auto cycles = counters.value(CYCLES);
+            report_ratio("host cycles per VM instruction", cycles, vm_instructions);
+            report_ratio("host instructions per VM instruction", counters.value(INSTRUCTIONS), vm_instructions);
+            report_ratio("branch misses per VM instruction", counters.value(BRANCH_MISSES), vm_instructions);
+            report_ratio("L1d read misses per VM instruction", counters.value(L1D_READ_MISSES), vm_instructions);
+            if (cycles.has_value()) {
+                report_ratio("host instructions per cycle", counters.value(INSTRUCTIONS),
+                             static_cast<double>(cycles.value()));
+            }
+        }
+        std::cerr << std::endl;
+    }
+
+    static void write_ratio(Json::Writer &writer, const char *key, std::optional<uint64_t> numerator,
+                            double denominator) {
+        if (numerator.has_value() && denominator > 0) {
+            writer.member(key, static_cast<double>(numerator.value()) / denominator);
+        }
+    }
+
+    void write_counters_json(Json::Writer &writer, const Counters &counters, size_t executed_instructions) {
+        writer.begin_object();
+        for (int counter = 0; counter < COUNTER_AMOUNT; counter++) {
+            const auto value = counters.value(static_cast<Counter>(counter));
+            if (value.has_value()) writer.member(COUNTER_DESCRIPTIONS[counter].key, uint64_t{value.value()});
+        }
+
+        const auto vm_instructions = static_cast<double>(executed_instructions);
+        const auto cycles = counters.value(CYCLES);
+        write_ratio(writer, "cycles_per_vm_instruction", cycles, vm_instructions);
+        write_ratio(writer, "instructions_per_vm_instruction", counters.value(INSTRUCTIONS), vm_instructions);
+        write_ratio(writer, "branch_misses_per_vm_instruction", counters.value(BRANCH_MISSES), vm_instructions);
+        write_ratio(writer, "l1d_read_misses_per_vm_instruction", counters.value(L1D_READ_MISSES), vm_instructions);
+        if (cycles.has_value()) {
+            write_ratio(writer, "instructions_per_cycle", counters.value(INSTRUCTIONS),
+                        static_cast<double>(cycles.value()));
+        }
+
+        writer.key("unavailable").begin_object();
+        for (int counter = 0; counter < COUNTER_AMOUNT; counter++) {
+            if (!counters.value(static_cast<Counter>(counter)).has_value()) {
+                writer.member(COUNTER_DESCRIPTIONS[counter].key, counters.error(static_cast<Counter>(counter)));
+            }
+        }
+        writer.end_object();
+        writer.end_object();
+    }
+}
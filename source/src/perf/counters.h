@@ -0,0 +1,78 @@
+#pragma once
+
+/**
+ * This header provides access to the hardware performance counters of the
+ * host machine, allowing to measure how the virtual machine implementation
+ * performs on the host's processor.
+ *
+ * Counters are collected using the perf_event_open interface of Linux. If the
+ * kernel does not allow access to a counter (e.g. due to perf_event_paranoid
+ * settings or missing hardware support), the counter is reported as unavailable
+ * while the remaining counters are still collected.
+ */
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include "json/json.h"
+
+namespace Perf {
+
+    enum Counter {
+        CYCLES,
+        INSTRUCTIONS,
+        BRANCH_MISSES,
+        L1D_READ_MISSES,
+        LLC_MISSES,
+        COUNTER_AMOUNT
+    };
+
+    class Counters {
+        std::array<int, COUNTER_AMOUNT> descriptors;
+        std::array<std::string, COUNTER_AMOUNT> errors;
+
+    public:
+        /**
+         * Opens all counters for the calling thread. Counters are not started yet.
+         */
+        Counters();
+
+        ~Counters();
+
+        Counters(const Counters &) = delete;
+
+        Counters &operator=(const Counters &) = delete;
+
+        void start() noexcept;
+
+        void stop() noexcept;
+
+        /**
+         * Returns the value of a counter, scaled if the counter was not active all the time.
+         * No value is returned, if the counter is not available.
+         */
+        [[nodiscard]] std::optional<uint64_t> value(Counter counter) const noexcept;
+
+        /**
+         * Returns the reason why a counter is not available.
+         */
+        [[nodiscard]] const std::string &error(Counter counter) const noexcept {
+            return errors[counter];
+        }
+    };
+
+    /**
+     * Prints the values of all counters and numbers derived from them to stderr.
+     *
+     * @param counters The counters measured during execution.
+     * @param executed_instructions The amount of instructions executed by the virtual machine.
+     */
+    void report_counters(const Counters &counters, size_t executed_instructions) noexcept;
+
+    /**
+     * Writes the values of all available counters and the numbers derived from them as JSON object.
+     * Counters that are not available are listed by name together with the reason.
+     */
+    void write_counters_json(Json::Writer &writer, const Counters &counters, size_t executed_instructions);
+}
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include "histogram.h"
+#include "json/json.h"
+#include "syntax/instructions.h"
+
+namespace Profiler {
+
+    constexpr int32_t KEY_INVERSE = 1 << 6;
+    constexpr int32_t KEY_BACKWARD = 1 << 7;
+
+    static_assert(std::all_of(std::begin(KNOWN_INSTRUCTIONS), std::end(KNOWN_INSTRUCTIONS),
+                              [](const InstructionData &instruction) { return instruction.binary < KEY_INVERSE; }),
+                  "Opcodes must fit into the keys of the histogram.");
+
+    /**
+     * Returns the key of the instruction executed next, using its opcode as decoded by VM::step_instr.
+     */
+    [[nodiscard]] static uint32_t key_of(int32_t instruction, Machine::Direction dir) {
+        const int32_t opcode = (instruction >> OPERAND_WIDTH) & OPCODE_WIDTH_MASK;
+        const int32_t decoded = dir == Machine::Forward ? opcode : INVERSE(opcode);
+        return (decoded & (KEY_INVERSE - 1)) | ((decoded & DIRECTION_BIT) ? KEY_INVERSE : 0) |
+               (dir == Machine::Backward ? KEY_BACKWARD : 0);
+    }
+
+    void run_with_histogram(Machine::VM &vm, OpcodeHistogram &histogram) {
+        // Keys of the last three executed instructions, the latest one in the lowest byte.
+        uint32_t history = 0;
+        uint64_t executed = 0;
+        do {
+            const uint32_t key = key_of(vm.program.at(vm.pc), vm.dir);
+            vm.step();
+
+            // The step succeeded, so the key describes a valid instruction.
+            history = ((history << 8) | key) & 0xFFFFFF;
+            executed++;
+            histogram.opcodes[key]++;
+            if (executed >= 2) histogram.pairs[history & 0xFFFF]++;
+            if (executed >= 3) histogram.triples[history]++;
+        } while (vm.running);
+    }
+
+
+    [[nodiscard]] static std::string name_of(uint32_t key) {
+        const int32_t binary = static_cast<int32_t>(key & (KEY_INVERSE - 1));
+        for (const InstructionData &instruction: KNOWN_INSTRUCTIONS) {
+            if (instruction.binary == binary) {
+                return std::string((key & KEY_BACKWARD) ? "bw:" : "fw:") +
+                       ((key & KEY_INVERSE) ? instruction.bw_mnemonic : instruction.fw_mnemonic);
+            }
+        }
+        return "unknown";
+    }
+
+    [[nodiscard]] static std::string name_of_sequence(uint32_t keys, size_t length) {
+        std::string result;
+        for (size_t i = length; i-- > 0;) {
+            result += name_of((keys >> (8 * i)) & 0xFF);
+            if (i > 0) result += " ";
+        }
+        return result;
+    }
+
+    using Counts = std::map<std::string, uint64_t>;
+
+    static void merge_counts(const Json::Value &document, std::string_view category, Counts &counts) {
+        const Json::Value *entries = document.find(category);
+        if (entries == nullptr) return;
+        if (entries->kind != Json::Value::OBJECT) {
+            throw std::invalid_argument("Histogram lists " + std::string(category) + " in an unexpected format.");
+        }
+        for (const auto &[name, count]: entries->members) {
+            counts[name] += static_cast<uint64_t>(count.number);
+        }
+    }
+
+    static void write_counts(Json::Writer &writer, std::string_view category, const Counts &counts) {
+        std::vector<std::pair<std::string, uint64_t>> sorted(counts.begin(), counts.end());
+        std::stable_sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) {
+            return a.second > b.second;
+        });
+
+        writer.key(category).begin_object();
+        for (const auto &[name, count]: sorted) {
+            writer.member(name, count);
+        }
+        writer.end_object();
+    }
+
+    void write_histogram(const std::string &filename, const OpcodeHistogram &histogram) {
+        Counts opcodes, pairs, triples;
+        for (uint32_t key = 0; key < OpcodeHistogram::KEYS; key++) {
+            if (histogram.opcodes[key] != 0) opcodes[name_of(key)] += histogram.opcodes[key];
+        }
+        for (uint32_t keys = 0; keys < histogram.pairs.size(); keys++) {
+            if (histogram.pairs[keys] != 0) pairs[name_of_sequence(keys, 2)] += histogram.pairs[keys];
+        }
+        for (const auto &[keys, count]: histogram.triples) {
+            triples[name_of_sequence(keys, 3)] += count;
+        }
+
+        uint64_t runs = 1;
+        if (std::filesystem::exists(filename)) {
+            const Json::Value existing = Json::read_file(filename);
+            if (existing.kind != Json::Value::OBJECT) {
+                throw std::invalid_argument("File " + filename + " does not contain a histogram.");
+            }
+            if (const Json::Value *existing_runs = existing.find("runs"); existing_runs != nullptr) {
+                runs += static_cast<uint64_t>(existing_runs->number);
+            }
+            merge_counts(existing, "opcodes", opcodes);
+            merge_counts(existing, "pairs", pairs);
+            merge_counts(existing, "triples", triples);
+        }
+
+        uint64_t instructions = 0;
+        for (const auto &[_, count]: opcodes) instructions += count;
+
+        std::ofstream output(filename);
+        if (!output) {
+            throw std::invalid_argument("File " + filename + " cannot be opened for writing.");
+        }
+        Json::Writer writer(output);
+        writer.begin_object()
+                .member("runs", runs)
+                .member("instructions", instructions);
+        write_counts(writer, "opcodes", opcodes);
+        write_counts(writer, "pairs", pairs);
+        write_counts(writer, "triples", triples);
+        writer.end_object();
+    }
+}
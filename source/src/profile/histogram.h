@@ -0,0 +1,50 @@
+#pragma once
+
+/**
+ * This header provides an opcode histogram for the virtual machine.
+ *
+ * While a program is executed with the histogram, the opcode of every executed
+ * instruction is counted together with the direction it was executed in. Pairs
+ * and triples of instructions executed one after another are counted as well,
+ * showing which sequences are worth specializing in the machine.
+ *
+ * Histograms are written as JSON documents naming every opcode by its executed
+ * mnemonic. If the written file already contains a histogram, both are merged,
+ * so counts can be accumulated over many runs and workloads.
+ */
+
+#include <array>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "machine/machine.h"
+
+namespace Profiler {
+
+    class OpcodeHistogram {
+    public:
+        /**
+         * Amount of distinct keys of executed opcodes. A key combines the opcode, as it is
+         * decoded by VM::step_instr, with the direction it is executed in.
+         */
+        static constexpr size_t KEYS = 256;
+
+        std::array<uint64_t, KEYS> opcodes{};
+        std::vector<uint64_t> pairs; // Indexed by KEYS * first + second.
+        std::unordered_map<uint32_t, uint64_t> triples; // Sparse, since most triples never occur.
+
+        OpcodeHistogram() : pairs(KEYS * KEYS) {}
+    };
+
+    /**
+     * Executes the program loaded into the machine, counting every executed opcode
+     * and all sequences of two and three executed opcodes in the given histogram.
+     */
+    void run_with_histogram(Machine::VM &vm, OpcodeHistogram &histogram);
+
+    /**
+     * Writes the histogram as JSON document to the given file. Counts of a histogram
+     * already present in the file are added to the written counts.
+     */
+    void write_histogram(const std::string &filename, const OpcodeHistogram &histogram);
+}
@@ -0,0 +1,111 @@
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <stdexcept>
+#include "profiler.h"
+#include "syntax/instructions.h"
+
+namespace Profiler {
+
+    using Clock = std::chrono::steady_clock;
+
+    void run_with_profiler(Machine::VM &vm, Profile &profile) {
+        auto last_step = Clock::now();
+        do {
+            const int32_t pc = vm.pc;
+            const Machine::Direction dir = vm.dir;
+
+            vm.step();
+
+            // The step succeeded, so pc was a valid address of the program.
+            const auto now = Clock::now();
+            AddressProfile &entry = profile.addresses[pc];
+            if (dir == Machine::Forward) entry.forward++;
+            else entry.backward++;
+            entry.time += now - last_step;
+            last_step = now;
+        } while (vm.running);
+    }
+
+
+    struct LabelProfile {
+        uint64_t forward = 0;
+        uint64_t backward = 0;
+        std::chrono::nanoseconds time{0};
+    };
+
+    static double milliseconds(std::chrono::nanoseconds time) {
+        return std::chrono::duration<double, std::milli>(time).count();
+    }
+
+    static double percentage(std::chrono::nanoseconds part, std::chrono::nanoseconds total) {
+        return total.count() == 0 ? 0.0 : 100.0 * static_cast<double>(part.count()) / static_cast<double>(total.count());
+    }
+
+    void write_profile(const std::string &filename, const Profile &profile, const SourceMap &source_map) {
+        std::ofstream output(filename);
+        if (!output) {
+            throw std::invalid_argument("File " + filename + " cannot be opened for writing.");
+        }
+
+        uint64_t total_forward = 0, total_backward = 0;
+        std::chrono::nanoseconds total_time{0};
+        std::map<std::string, LabelProfile> labels;
+
+        for (size_t address = 0; address < profile.addresses.size(); address++) {
+            const AddressProfile &entry = profile.addresses[address];
+            total_forward += entry.forward;
+            total_backward += entry.backward;
+            total_time += entry.time;
+
+            const SourceLocation &location = source_map.at(static_cast<int32_t>(address));
+            LabelProfile &label = labels[location.label != nullptr ? location.label : "<no label>"];
+            label.forward += entry.forward;
+            label.backward += entry.backward;
+            label.time += entry.time;
+        }
+
+        output << std::fixed << std::setprecision(3);
+        output << "Executed " << (total_forward + total_backward) << " instructions ("
+               << total_forward << " forward, " << total_backward << " backward) in "
+               << milliseconds(total_time) << "ms.\n\n";
+
+        // Summary per label, ordered by time spent on the instructions following a label.
+        std::vector<std::pair<std::string, LabelProfile>> sorted_labels(labels.begin(), labels.end());
+        std::ranges::stable_sort(sorted_labels, [](const auto &a, const auto &b) {
+            return a.second.time > b.second.time;
+        });
+
+        output << std::left << std::setw(24) << "label" << std::right
+               << std::setw(14) << "forward" << std::setw(14) << "backward"
+               << std::setw(14) << "time (ms)" << std::setw(9) << "time %" << "\n";
+        for (const auto &[name, label]: sorted_labels) {
+            if (label.forward == 0 && label.backward == 0) continue;
+
+            output << std::left << std::setw(24) << name << std::right
+                   << std::setw(14) << label.forward << std::setw(14) << label.backward
+                   << std::setw(14) << milliseconds(label.time)
+                   << std::setw(9) << percentage(label.time, total_time) << "\n";
+        }
+        output << "\n";
+
+        // Listing of all instructions in program order.
+        output << std::setw(8) << "address" << std::setw(7) << "line" << "  "
+               << std::left << std::setw(24) << "location" << std::setw(12) << "instruction" << std::right
+               << std::setw(14) << "forward" << std::setw(14) << "backward"
+               << std::setw(14) << "time (ms)" << std::setw(9) << "time %" << "\n";
+        for (size_t address = 0; address < profile.addresses.size(); address++) {
+            const AddressProfile &entry = profile.addresses[address];
+            const SourceLocation &location = source_map.at(static_cast<int32_t>(address));
+
+            output << std::setw(8) << address << std::setw(7) << location.line->linenumber << "  "
+                   << std::left << std::setw(24) << source_map.describe(static_cast<int32_t>(address))
+                   << std::setw(12) << location.line->value.instruction.data->fw_mnemonic << std::right
+                   << std::setw(14) << entry.forward << std::setw(14) << entry.backward
+                   << std::setw(14) << milliseconds(entry.time)
+                   << std::setw(9) << percentage(entry.time, total_time) << "\n";
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+/**
+ * This header provides an instrumenting profiler for the virtual machine.
+ *
+ * While a program is executed with the profiler, every executed instruction
+ * is recorded together with the direction it was executed in and the time
+ * spent on it. The collected data is reported per address and per label,
+ * using the source lines an instruction was translated from.
+ */
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include "machine/machine.h"
+#include "source_map.h"
+
+namespace Profiler {
+
+    struct AddressProfile {
+        uint64_t forward;
+        uint64_t backward;
+        std::chrono::nanoseconds time;
+    };
+
+    struct Profile {
+        std::vector<AddressProfile> addresses;
+
+        explicit Profile(size_t program_size) : addresses(program_size) {}
+    };
+
+    /**
+     * Executes the program loaded into the machine, recording every executed
+     * instruction in the given Profile.
+     */
+    void run_with_profiler(Machine::VM &vm, Profile &profile);
+
+    /**
+     * Writes a human-readable report of the collected Profile to the given file.
+     */
+    void write_profile(const std::string &filename, const Profile &profile, const SourceMap &source_map);
+}
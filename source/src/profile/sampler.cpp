@@ -0,0 +1,197 @@
+
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <sys/time.h>
+#include "sampler.h"
+#include "syntax/instructions.h"
+
+namespace Profiler {
+
+    // State shared with the signal handler. Only one machine can be sampled at a time.
+    static const Machine::VM *sampled_vm = nullptr;
+    static SampleBuffer *sample_buffer = nullptr;
+
+    // Samples are left uninitialized, so only pages actually used for samples are touched.
+    SampleBuffer::SampleBuffer(size_t capacity) : samples(new Sample[capacity]), capacity(capacity),
+                                                  recorded(0), dropped(0) {
+    }
+
+    /**
+     * Signal handler recording the current machine state. Only reads from the
+     * machine, so a sample may observe an instruction that is half-executed.
+     * Frame pointers are therefore validated before being followed.
+     */
+    static void record_sample(int) {
+        const Machine::VM *vm = sampled_vm;
+        SampleBuffer *buffer = sample_buffer;
+        if (vm == nullptr || buffer == nullptr) return;
+
+        const size_t index = buffer->recorded.load(std::memory_order_relaxed);
+        if (index >= buffer->capacity) {
+            buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        Sample &sample = buffer->samples[index];
+        sample.pc = vm->pc;
+        sample.dir = vm->dir;
+        sample.depth = 0;
+
+        const int32_t *stack = vm->stack.data();
+        const auto stack_size = static_cast<int32_t>(vm->stack.size());
+        int32_t fp = vm->fp;
+        while (sample.depth < MAX_SAMPLED_FRAMES && fp > 0 && fp < stack_size) {
+            sample.return_offsets[sample.depth++] = stack[fp - 1];
+
+            const int32_t saved_fp = stack[fp];
+            if (saved_fp < 0 || saved_fp >= fp) break;
+            fp = saved_fp;
+        }
+
+        buffer->recorded.store(index + 1, std::memory_order_relaxed);
+    }
+
+    static void set_sampling_interval(long microseconds) {
+        itimerval interval{};
+        interval.it_interval.tv_sec = microseconds / 1000000;
+        interval.it_interval.tv_usec = microseconds % 1000000;
+        interval.it_value = interval.it_interval;
+        if (setitimer(ITIMER_PROF, &interval, nullptr) != 0) {
+            throw std::runtime_error(std::string("Cannot start profiling timer: ") + strerror(errno));
+        }
+    }
+
+    static void stop_sampling(const struct sigaction &previous_action) {
+        set_sampling_interval(0);
+        sigaction(SIGPROF, &previous_action, nullptr);
+        sampled_vm = nullptr;
+        sample_buffer = nullptr;
+    }
+
+    void run_with_sampler(Machine::VM &vm, unsigned int frequency, SampleBuffer &buffer) {
+        if (frequency == 0 || frequency > MAXIMUM_FREQUENCY) {
+            throw std::invalid_argument("Sampling frequency must be between 1 and " +
+                                        std::to_string(MAXIMUM_FREQUENCY) + " Hz.");
+        }
+
+        struct sigaction action{}, previous_action{};
+        action.sa_handler = record_sample;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+
+        sampled_vm = &vm;
+        sample_buffer = &buffer;
+        sigaction(SIGPROF, &action, &previous_action);
+        set_sampling_interval(std::max(1L, 1000000L / static_cast<long>(frequency)));
+
+        try {
+            vm.run();
+        } catch (...) {
+            stop_sampling(previous_action);
+            throw;
+        }
+        stop_sampling(previous_action);
+    }
+
+
+    /**
+     * Procedures are entered through a trampoline, where the entry point is
+     * a call instruction directly preceded by the branch to the procedure's
+     * end. The return offset on the stack is negated directly after entering
+     * the procedure or directly before leaving it, so a neg instruction
+     * either follows or precedes the entry point.
+     */
+    struct ProcedureEntry {
+        int32_t address;
+        bool is_negated_on_entry;
+    };
+
+    static bool is_instruction(const SourceMap &source_map, int32_t address, const char *mnemonic) {
+        return source_map.contains(address) &&
+               strcmp(source_map.at(address).line->value.instruction.data->fw_mnemonic, mnemonic) == 0;
+    }
+
+    /**
+     * Computes the procedure enclosing every address of the program.
+     */
+    static std::vector<std::optional<ProcedureEntry>> find_procedures(const SourceMap &source_map) {
+        std::vector<std::optional<ProcedureEntry>> procedures(source_map.size());
+
+        std::optional<ProcedureEntry> current;
+        for (int32_t address = 0; static_cast<size_t>(address) < source_map.size(); address++) {
+            if (is_instruction(source_map, address, "call")) {
+                if (is_instruction(source_map, address - 1, "branch")) {
+                    current = ProcedureEntry{address, is_instruction(source_map, address + 1, "neg")};
+                } else if (is_instruction(source_map, address - 1, "neg") &&
+                           is_instruction(source_map, address - 2, "branch")) {
+                    current = ProcedureEntry{address, false};
+                }
+            }
+            procedures[address] = current;
+        }
+        return procedures;
+    }
+
+    static std::string frame_name(const SourceMap &source_map, int32_t address) {
+        const char *label = source_map.contains(address) ? source_map.at(address).label : nullptr;
+        return label != nullptr ? label : "[unlabeled]";
+    }
+
+    /**
+     * Reconstructs the call chain of a sample and formats it as collapsed stack, outermost frame first.
+     */
+    static std::string collapse(const Sample &sample, const SourceMap &source_map,
+                                const std::vector<std::optional<ProcedureEntry>> &procedures) {
+        std::vector<std::string> frames = {frame_name(source_map, sample.pc)};
+
+        int32_t pc = sample.pc;
+        for (uint32_t depth = 0; depth < sample.depth; depth++) {
+            if (!source_map.contains(pc) || !procedures[pc].has_value()) break;
+
+            const ProcedureEntry &entry = procedures[pc].value();
+            const int32_t offset = sample.return_offsets[depth];
+            const int32_t call_site = entry.is_negated_on_entry ? entry.address + offset : entry.address - offset;
+            if (!is_instruction(source_map, call_site, "call") && !is_instruction(source_map, call_site, "uncall")) {
+                break; // Frame does not belong to the procedure, e.g. while it is being set up.
+            }
+
+            frames.push_back(frame_name(source_map, call_site));
+            pc = call_site;
+        }
+
+        std::string result = sample.dir == Machine::Forward ? "[forward]" : "[backward]";
+        for (auto frame = frames.rbegin(); frame != frames.rend(); ++frame) {
+            result += ";" + *frame;
+        }
+        return result;
+    }
+
+    void write_collapsed_stacks(const std::string &filename, const SampleBuffer &buffer,
+                                const SourceMap &source_map) {
+        std::ofstream output(filename);
+        if (!output) {
+            throw std::invalid_argument("File " + filename + " cannot be opened for writing.");
+        }
+
+        const auto procedures = find_procedures(source_map);
+        std::map<std::string, size_t> stacks;
+        const size_t recorded = buffer.recorded.load();
+        for (size_t index = 0; index < recorded; index++) {
+            stacks[collapse(buffer.samples[index], source_map, procedures)]++;
+        }
+
+        for (const auto &[stack, count]: stacks) {
+            output << stack << " " << count << "\n";
+        }
+
+        if (buffer.dropped.load() > 0) {
+            fprintf(stderr, "[WARNING] Sample buffer exhausted, %zu samples have been dropped.\n",
+                    buffer.dropped.load());
+        }
+    }
+}
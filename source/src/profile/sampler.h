@@ -0,0 +1,67 @@
+#pragma once
+
+/**
+ * This header provides a sampling profiler for the virtual machine.
+ *
+ * Instead of instrumenting every executed instruction, the sampling profiler
+ * periodically interrupts the machine using a profiling timer signal. On every
+ * interrupt, the program counter, the execution direction and the chain of
+ * active procedure frames are recorded. Frames are found by following the
+ * frame pointers saved by asf on the operand stack.
+ *
+ * Recorded samples are written in the collapsed stack format understood by
+ * common flamegraph tools: One line per distinct call chain, with frames
+ * separated by semicolons and followed by the amount of samples.
+ */
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include "machine/machine.h"
+#include "source_map.h"
+
+namespace Profiler {
+
+    /**
+     * Maximum amount of procedure frames recorded per sample.
+     */
+    constexpr size_t MAX_SAMPLED_FRAMES = 32;
+
+    struct Sample {
+        int32_t pc;
+        Machine::Direction dir;
+        uint32_t depth;
+        /**
+         * The return offsets stored below each active frame, innermost first.
+         */
+        int32_t return_offsets[MAX_SAMPLED_FRAMES];
+    };
+
+    struct SampleBuffer {
+        std::unique_ptr<Sample[]> samples;
+        size_t capacity;
+        std::atomic<size_t> recorded;
+        std::atomic<size_t> dropped;
+
+        explicit SampleBuffer(size_t capacity);
+    };
+
+    /**
+     * Highest supported sampling frequency in Hz, limited by the resolution of the sampling timer.
+     */
+    constexpr unsigned int MAXIMUM_FREQUENCY = 1000000;
+
+    /**
+     * Executes the program loaded into the machine, while sampling its state
+     * frequency times per second of consumed CPU time.
+     */
+    void run_with_sampler(Machine::VM &vm, unsigned int frequency, SampleBuffer &buffer);
+
+    /**
+     * Writes the recorded samples in collapsed stack format to the given file.
+     * Frames are named after the label nearest to their program counter.
+     */
+    void write_collapsed_stacks(const std::string &filename, const SampleBuffer &buffer,
+                                const SourceMap &source_map);
+}
@@ -0,0 +1,34 @@
+
+#include "source_map.h"
+
+namespace Profiler {
+
+    SourceMap::SourceMap(const Program &program) {
+        locations.reserve(program.code.size());
+
+        const char *label = nullptr;
+        int32_t label_address = 0;
+        for (const auto &line: program.code) {
+            if (!line.labels->isEmpty) {
+                label = line.labels->head;
+                label_address = line.base_address;
+            }
+            locations.push_back({&line, label, label_address});
+        }
+    }
+
+    std::string SourceMap::describe(int32_t address) const {
+        if (!contains(address)) {
+            return "<" + std::to_string(address) + ">";
+        }
+
+        const SourceLocation &location = locations[address];
+        if (location.label == nullptr) {
+            return "<" + std::to_string(address) + ">";
+        } else if (location.label_address == address) {
+            return location.label;
+        } else {
+            return std::string(location.label) + "+" + std::to_string(address - location.label_address);
+        }
+    }
+}
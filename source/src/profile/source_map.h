@@ -0,0 +1,54 @@
+#pragma once
+
+/**
+ * Maps addresses of the assembled program back to the source lines
+ * they were translated from. This allows tools inspecting a running
+ * machine to report their findings in terms of labels and line numbers.
+ */
+
+#include <string>
+#include <vector>
+#include "syntax/syntax.h"
+
+namespace Profiler {
+
+    struct SourceLocation {
+        /**
+         * The Line an instruction was translated from.
+         */
+        const Line *line;
+        /**
+         * The nearest label defined at or before the instruction.
+         * This is nullptr, if no label precedes the instruction.
+         */
+        const char *label;
+        /**
+         * The address the nearest label refers to.
+         */
+        int32_t label_address;
+    };
+
+    class SourceMap {
+        std::vector<SourceLocation> locations;
+
+    public:
+        explicit SourceMap(const Program &program);
+
+        [[nodiscard]] size_t size() const noexcept {
+            return locations.size();
+        }
+
+        [[nodiscard]] bool contains(int32_t address) const noexcept {
+            return address >= 0 && static_cast<size_t>(address) < locations.size();
+        }
+
+        [[nodiscard]] const SourceLocation &at(int32_t address) const {
+            return locations.at(address);
+        }
+
+        /**
+         * Describes an address relative to its nearest label, e.g. "loop+3".
+         */
+        [[nodiscard]] std::string describe(int32_t address) const;
+    };
+}
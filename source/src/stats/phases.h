@@ -0,0 +1,42 @@
+#pragma once
+
+/**
+ * This header provides timing of the phases required to load a program.
+ */
+
+#include <chrono>
+#include <utility>
+#include <vector>
+
+namespace Stats {
+
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * Durations of all phases recorded while loading a program, in the order they were executed.
+     */
+    class PhaseTimes {
+        std::vector<std::pair<const char *, Clock::duration>> phases;
+
+    public:
+        /**
+         * Records a phase started at the given time and ending now. Returns the current time,
+         * which can be used as start of the next phase.
+         */
+        Clock::time_point record(const char *phase, Clock::time_point start) {
+            const auto now = Clock::now();
+            phases.emplace_back(phase, now - start);
+            return now;
+        }
+
+        [[nodiscard]] const std::vector<std::pair<const char *, Clock::duration>> &recorded() const {
+            return phases;
+        }
+
+        [[nodiscard]] Clock::duration total() const {
+            Clock::duration result{0};
+            for (const auto &[_, duration]: phases) result += duration;
+            return result;
+        }
+    };
+}
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <string_view>
+#include <sys/resource.h>
+#include "stats.h"
+#include "json/json.h"
+#include "syntax/instructions.h"
+
+namespace Stats {
+
+    static constexpr int32_t binary_of(std::string_view mnemonic) {
+        for (const auto &instruction: KNOWN_INSTRUCTIONS) {
+            if (mnemonic == instruction.fw_mnemonic) return instruction.binary;
+        }
+        return -1;
+    }
+
+    static constexpr int32_t PUSHM = binary_of("pushm");
+    static constexpr int32_t LOAD = binary_of("load");
+    static constexpr int32_t MEMSWAP = binary_of("memswap");
+
+    size_t Usage::touched_page_count() const {
+        return std::count(touched_pages.begin(), touched_pages.end(), true);
+    }
+
+    static void touch(Usage &usage, const Machine::VM &vm, int64_t address) {
+        if (address >= 0 && address < static_cast<int64_t>(vm.memory.size())) {
+            usage.touched_pages[address / PAGE_WORDS] = true;
+        }
+    }
+
+    /**
+     * Records the memory accessed by the next instruction. Invalid accesses are
+     * not recorded, since they are reported as errors by the machine.
+     */
+    static void record_memory_access(Usage &usage, const Machine::VM &vm) {
+        if (vm.pc < 0 || static_cast<size_t>(vm.pc) >= vm.program.size()) return;
+
+        const int32_t instruction = vm.program[vm.pc];
+        const int32_t operand = sign_extend(instruction & OPERAND_WIDTH_MASK);
+        const int32_t opcode = (instruction >> OPERAND_WIDTH) & OPCODE_WIDTH_MASK;
+        const int32_t stack_top = vm.sp >= 1 ? vm.stack[vm.sp - 1] : 0;
+        const int32_t stack_second = vm.sp >= 2 ? vm.stack[vm.sp - 2] : 0;
+
+        switch (vm.dir == Machine::Forward ? opcode : INVERSE(opcode)) {
+            case PUSHM:
+            case INVERSE(PUSHM): // popm
+                touch(usage, vm, operand);
+                break;
+            case LOAD:
+                if (vm.sp >= 1) touch(usage, vm, int64_t{stack_top} + operand);
+                break;
+            case INVERSE(LOAD): // store
+                if (vm.sp >= 2) touch(usage, vm, int64_t{stack_second} + operand);
+                break;
+            case MEMSWAP:
+            case INVERSE(MEMSWAP):
+                if (vm.sp >= 2) {
+                    touch(usage, vm, int64_t{stack_top} + operand);
+                    touch(usage, vm, int64_t{stack_second} + operand);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    void run_with_statistics(Machine::VM &vm, Usage &usage) {
+        do {
+            record_memory_access(usage, vm);
+            vm.step();
+            // The stack pointer moves in one direction within an instruction, so checking after it suffices.
+            usage.max_stack_depth = std::max(usage.max_stack_depth, vm.sp);
+        } while (vm.running);
+    }
+
+    std::optional<size_t> peak_resident_memory() {
+        struct rusage usage{};
+        if (getrusage(RUSAGE_SELF, &usage) != 0) return std::nullopt;
+        return static_cast<size_t>(usage.ru_maxrss) * 1024; // Reported in kilobytes on Linux.
+    }
+
+    static double milliseconds(Clock::duration time) {
+        return std::chrono::duration<double, std::milli>(time).count();
+    }
+
+    static double instructions_per_second(const Statistics &statistics) {
+        return static_cast<double>(statistics.instructions) /
+               std::chrono::duration<double>(statistics.run_time).count();
+    }
+
+    void report_statistics(std::ostream &output, const Statistics &statistics) {
+        const auto precision = output.precision(2);
+        const auto flags = output.setf(std::ios::fixed, std::ios::floatfield);
+
+        output << "Loaded program in " << milliseconds(statistics.load_times.total()) << "ms (";
+        bool is_first = true;
+        for (const auto &[phase, time]: statistics.load_times.recorded()) {
+            output << (is_first ? "" : ", ") << phase << " " << milliseconds(time) << "ms";
+            is_first = false;
+        }
+        output << ").\n";
+        output << "Executed " << statistics.instructions << " instructions in " << milliseconds(statistics.run_time)
+               << "ms (~ " << (long) floor(instructions_per_second(statistics)) << " instr/s)\n";
+
+        if (const auto peak = peak_resident_memory(); peak.has_value()) {
+            output << "Peak resident memory: " << (peak.value() / 1024) << " KiB\n";
+        }
+        if (statistics.usage.has_value()) {
+            const Usage &usage = statistics.usage.value();
+            output << "Maximum stack depth: " << usage.max_stack_depth << " of " << statistics.stack_size
+                   << " values\n";
+            output << "Touched memory pages: " << usage.touched_page_count() << " of " << usage.touched_pages.size()
+                   << " (" << PAGE_WORDS << " words per page)\n";
+        }
+        output << std::endl;
+
+        output.precision(precision);
+        output.flags(flags);
+    }
+
+    void write_statistics_json(std::ostream &output, const Statistics &statistics) {
+        Json::Writer writer(output);
+        writer.begin_object();
+
+        writer.key("load_ms").begin_object();
+        for (const auto &[phase, time]: statistics.load_times.recorded()) {
+            writer.member(phase, milliseconds(time));
+        }
+        writer.member("total", milliseconds(statistics.load_times.total()));
+        writer.end_object();
+
+        writer.key("execution").begin_object()
+                .member("instructions", uint64_t{statistics.instructions})
+                .member("time_ms", milliseconds(statistics.run_time))
+                .member("instructions_per_second", instructions_per_second(statistics))
+                .member("instrumented", statistics.usage.has_value())
+                .end_object();
+
+        writer.key("memory").begin_object();
+        if (const auto peak = peak_resident_memory(); peak.has_value()) {
+            writer.member("peak_rss_bytes", uint64_t{peak.value()});
+        }
+        writer.member("stack_size", uint64_t{statistics.stack_size})
+                .member("memory_size", uint64_t{statistics.memory_size})
+                .member("page_words", uint64_t{PAGE_WORDS});
+        if (statistics.usage.has_value()) {
+            const Usage &usage = statistics.usage.value();
+            writer.member("max_stack_depth", usage.max_stack_depth)
+                    .member("touched_pages", uint64_t{usage.touched_page_count()});
+        }
+        writer.end_object();
+
+        if (statistics.counters != nullptr) {
+            writer.key("perf_counters");
+            Perf::write_counters_json(writer, *statistics.counters, statistics.instructions);
+        }
+
+        writer.end_object();
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+/**
+ * This header provides runtime statistics about loading and executing a program.
+ *
+ * Besides the time spent in every phase of loading a program and executing it,
+ * the statistics describe the memory used by the host process and by the
+ * executed program. The latter is collected by executing the program with an
+ * instrumented loop, which records the stack depth and accessed memory after
+ * every instruction.
+ */
+
+#include <optional>
+#include <ostream>
+#include <vector>
+#include "machine/machine.h"
+#include "perf/counters.h"
+#include "phases.h"
+
+namespace Stats {
+
+    /**
+     * Amount of words within a page of the machine's memory.
+     */
+    constexpr size_t PAGE_WORDS = 1024;
+
+    /**
+     * Usage of the machine's stack and memory, recorded while executing a program.
+     */
+    struct Usage {
+        int32_t max_stack_depth = 0;
+        std::vector<bool> touched_pages;
+
+        explicit Usage(const Machine::VM &vm) :
+                max_stack_depth(vm.sp), touched_pages((vm.memory.size() + PAGE_WORDS - 1) / PAGE_WORDS) {}
+
+        [[nodiscard]] size_t touched_page_count() const;
+    };
+
+    struct Statistics {
+        PhaseTimes load_times;
+        Clock::duration run_time{0};
+        size_t instructions = 0;
+        size_t stack_size = 0;
+        size_t memory_size = 0;
+        /**
+         * Only present if the program was executed with run_with_statistics.
+         */
+        std::optional<Usage> usage;
+        /**
+         * Only present if hardware counters were collected during execution.
+         */
+        const Perf::Counters *counters = nullptr;
+    };
+
+    /**
+     * Executes the program loaded into the machine, recording the maximum stack depth
+     * and all memory pages accessed by the program in the given Usage.
+     */
+    void run_with_statistics(Machine::VM &vm, Usage &usage);
+
+    /**
+     * Returns the peak resident set size of the host process in bytes, if it is available.
+     */
+    [[nodiscard]] std::optional<size_t> peak_resident_memory();
+
+    /**
+     * Writes a human-readable report of the given Statistics.
+     */
+    void report_statistics(std::ostream &output, const Statistics &statistics);
+
+    /**
+     * Writes the given Statistics as JSON document.
+     */
+    void write_statistics_json(std::ostream &output, const Statistics &statistics);
+}
@@ -3,6 +3,7 @@
 #include <stddef.h>
 #include <malloc.h>
 #include <stdlib.h>
+#include <string.h>
 #include "csyntax.h"
 
 static StringList nil_StringList = {
@@ -13,10 +14,6 @@ static OperandList nil_OperandList = {
         .isEmpty = true
 };
 
-static LineList nil_LineList = {
-        .isEmpty = true
-};
-
 StringList *emptyStringList() {
     return &nil_StringList;
 }
@@ -25,13 +22,17 @@ OperandList *emptyOperandList() {
     return &nil_OperandList;
 }
 
-LineList *emptyLineList() {
-    return &nil_LineList;
+LineBuffer emptyLineBuffer() {
+    LineBuffer buffer = {
+            .lines = NULL,
+            .size = 0,
+            .capacity = 0,
+    };
+    return buffer;
 }
 
 
-static void *allocate(size_t size) {
-    void *p = malloc(size);
+static void *checked(void *p) {
     if (p == NULL) {
         printf("out of memory");
         exit(1);
@@ -39,6 +40,118 @@ static void *allocate(size_t size) {
     return p;
 }
 
+/*
+ * List nodes live as long as the parsed program, so they are taken from
+ * large chunks instead of being allocated individually.
+ */
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+static char *arena_position = NULL;
+static size_t arena_remaining = 0;
+
+static void *allocate(size_t size) {
+    const size_t alignment = _Alignof(max_align_t);
+    size = (size + alignment - 1) & ~(alignment - 1);
+
+    if (size > ARENA_CHUNK_SIZE) {
+        return checked(malloc(size));
+    }
+    if (size > arena_remaining) {
+        arena_position = checked(malloc(ARENA_CHUNK_SIZE));
+        arena_remaining = ARENA_CHUNK_SIZE;
+    }
+
+    void *p = arena_position;
+    arena_position += size;
+    arena_remaining -= size;
+    return p;
+}
+
+
+
+typedef struct {
+    uint32_t id;
+    uint32_t hash;
+    char text[];
+} InternedSymbol;
+
+// Open addressing hash table with a power of two capacity.
+static InternedSymbol **symbol_table = NULL;
+static uint32_t symbol_table_capacity = 0;
+static uint32_t symbol_count = 0;
+
+static uint32_t hash_symbol(const char *value, size_t length) {
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char) value[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static InternedSymbol **lookup_slot(const char *value, size_t length, uint32_t hash) {
+    uint32_t index = hash & (symbol_table_capacity - 1);
+    for (;;) {
+        InternedSymbol **slot = &symbol_table[index];
+        if (*slot == NULL ||
+            ((*slot)->hash == hash && strncmp((*slot)->text, value, length) == 0 && (*slot)->text[length] == 0)) {
+            return slot;
+        }
+        index = (index + 1) & (symbol_table_capacity - 1);
+    }
+}
+
+static void grow_symbol_table() {
+    InternedSymbol **old_table = symbol_table;
+    const uint32_t old_capacity = symbol_table_capacity;
+
+    symbol_table_capacity = old_capacity == 0 ? 1024 : 2 * old_capacity;
+    symbol_table = checked(calloc(symbol_table_capacity, sizeof(InternedSymbol *)));
+    for (uint32_t i = 0; i < old_capacity; i++) {
+        if (old_table[i] != NULL) {
+            InternedSymbol *symbol = old_table[i];
+            *lookup_slot(symbol->text, strlen(symbol->text), symbol->hash) = symbol;
+        }
+    }
+    free(old_table);
+}
+
+const char *internSymbol(const char *value, size_t length) {
+    if (2 * (symbol_count + 1) > symbol_table_capacity) {
+        grow_symbol_table();
+    }
+
+    const uint32_t hash = hash_symbol(value, length);
+    InternedSymbol **slot = lookup_slot(value, length, hash);
+    if (*slot == NULL) {
+        InternedSymbol *symbol = allocate(sizeof(InternedSymbol) + length + 1);
+        symbol->id = symbol_count++;
+        symbol->hash = hash;
+        memcpy(symbol->text, value, length);
+        symbol->text[length] = 0;
+        *slot = symbol;
+    }
+    return (*slot)->text;
+}
+
+const char *findSymbol(const char *value) {
+    if (symbol_table_capacity == 0) {
+        return NULL;
+    }
+
+    const size_t length = strlen(value);
+    InternedSymbol *symbol = *lookup_slot(value, length, hash_symbol(value, length));
+    return symbol == NULL ? NULL : symbol->text;
+}
+
+uint32_t symbolId(const char *symbol) {
+    const InternedSymbol *interned = (const InternedSymbol *) (symbol - offsetof(InternedSymbol, text));
+    return interned->id;
+}
+
+uint32_t symbolCount() {
+    return symbol_count;
+}
+
 
 StringList *prependString(char *head, StringList *tail) {
     StringList *cons = allocate(sizeof(StringList));
@@ -56,24 +169,39 @@ OperandList *prependOperand(Operand operand, OperandList *tail) {
     return cons;
 }
 
-LineList *prependLine(Line line, LineList *tail) {
-    LineList *cons = allocate(sizeof(LineList));
-    cons->isEmpty = false;
-    cons->head = line;
-    cons->tail = tail;
-    return cons;
+StringList *reverseStrings(StringList *list) {
+    StringList *reversed = emptyStringList();
+    while (!list->isEmpty) {
+        StringList *tail = list->tail;
+        list->tail = reversed;
+        reversed = list;
+        list = tail;
+    }
+    return reversed;
 }
 
-LineList *merge(LineList *a, LineList *b) {
-    if (a->isEmpty) return b;
-    else {
-        LineList *end = a;
-        while (!end->tail->isEmpty) {
-            end = end->tail;
-        }
-        end->tail = b;
-        return a;
+OperandList *reverseOperands(OperandList *list) {
+    OperandList *reversed = emptyOperandList();
+    while (!list->isEmpty) {
+        OperandList *tail = list->tail;
+        list->tail = reversed;
+        reversed = list;
+        list = tail;
+    }
+    return reversed;
+}
+
+void appendLine(LineBuffer *buffer, Line line) {
+    if (buffer->size == buffer->capacity) {
+        buffer->capacity = buffer->capacity == 0 ? 256 : 2 * buffer->capacity;
+        buffer->lines = checked(realloc(buffer->lines, buffer->capacity * sizeof(Line)));
     }
+    buffer->lines[buffer->size++] = line;
+}
+
+void freeLineBuffer(LineBuffer *buffer) {
+    free(buffer->lines);
+    *buffer = emptyLineBuffer();
 }
 
 Operand noOperand() {
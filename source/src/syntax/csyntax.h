@@ -90,19 +90,43 @@ typedef struct {
     } value;
 } Line;
 
-typedef struct line_list {
-    bool isEmpty;
-    Line head;
-    struct line_list *tail;
-} LineList;
+typedef struct {
+    Line *lines;
+    size_t size;
+    size_t capacity;
+} LineBuffer;
 
 typedef struct {
-    LineList *code;
-    LineList *data;
-    LineList *bss;
+    LineBuffer code;
+    LineBuffer data;
+    LineBuffer bss;
+    StringList *exports;
 } ParsedProgram;
 
 
+/*
+ * Symbols (identifiers and labels) are interned in a pool shared by all parses.
+ * Equal symbols are represented by the same pointer, which also carries a dense
+ * id usable as an index. Every symbol stored in the syntax tree is interned.
+ */
+
+const char *internSymbol(const char *value, size_t length);
+
+// Returns the interned representation of value or NULL, if it was never interned.
+const char *findSymbol(const char *value);
+
+uint32_t symbolId(const char *symbol);
+
+uint32_t symbolCount();
+
+
+/*
+ * Looks up an instruction by its mnemonic. If the given text is a known mnemonic, true
+ * is returned and the instructions offset and direction are stored. (see instructions.cpp)
+ */
+bool lookupMnemonic(const char *text, size_t length, size_t *offset, bool *is_forward);
+
+
 StringList *emptyStringList();
 
 StringList *prependString(char *string, StringList *tail);
@@ -111,11 +135,15 @@ OperandList *emptyOperandList();
 
 OperandList *prependOperand(Operand operand, OperandList *tail);
 
-LineList *emptyLineList();
+StringList *reverseStrings(StringList *list);
+
+OperandList *reverseOperands(OperandList *list);
+
+LineBuffer emptyLineBuffer();
 
-LineList *prependLine(Line line, LineList *tail);
+void appendLine(LineBuffer *buffer, Line line);
 
-LineList *merge(LineList *a, LineList *b);
+void freeLineBuffer(LineBuffer *buffer);
 
 Operand noOperand();
 
@@ -1,7 +1,12 @@
 
+#include <array>
 #include <cstring>
 #include "instructions.h"
 
+extern "C" {
+#include "csyntax.h"
+}
+
 static InstructionData *INVERSE_DATA = nullptr;
 static constexpr size_t INSTRUCTION_COUNT = sizeof(KNOWN_INSTRUCTIONS) / sizeof(*KNOWN_INSTRUCTIONS);
 
@@ -32,4 +37,90 @@ static constexpr size_t INSTRUCTION_COUNT = sizeof(KNOWN_INSTRUCTIONS) / sizeof(
     }
 
     return ((is_forward) ? KNOWN_INSTRUCTIONS : INVERSE_DATA)[offset];
-}
\ No newline at end of file
+}
+
+/*
+ * Mnemonics are recognized using a perfect hash table, which is built at compile time
+ * from KNOWN_INSTRUCTIONS. The hash function is seeded and the first seed mapping all
+ * mnemonics to distinct slots is used.
+ */
+namespace {
+    constexpr size_t MNEMONIC_TABLE_SIZE = 512;
+
+    struct MnemonicEntry {
+        const char *mnemonic = nullptr;
+        size_t length = 0;
+        size_t offset = 0;
+        bool is_forward = false;
+    };
+
+    struct MnemonicTable {
+        uint32_t seed = 0;
+        std::array<MnemonicEntry, MNEMONIC_TABLE_SIZE> entries{};
+    };
+
+    [[nodiscard]] constexpr size_t length_of(const char *string) noexcept {
+        size_t length = 0;
+        while (string[length] != 0) length++;
+        return length;
+    }
+
+    [[nodiscard]] constexpr bool equal_mnemonics(const char *a, const char *b) noexcept {
+        size_t i = 0;
+        while (a[i] != 0 && a[i] == b[i]) i++;
+        return a[i] == b[i];
+    }
+
+    [[nodiscard]] constexpr size_t hash_mnemonic(const char *text, size_t length, uint32_t seed) noexcept {
+        uint32_t hash = seed;
+        for (size_t i = 0; i < length; i++) {
+            hash = (hash ^ static_cast<unsigned char>(text[i])) * 16777619u;
+        }
+        return (hash ^ (hash >> 16)) % MNEMONIC_TABLE_SIZE;
+    }
+
+    [[nodiscard]] constexpr bool insert_mnemonic(MnemonicTable &table, const char *mnemonic,
+                                                 size_t offset, bool is_forward) noexcept {
+        const size_t length = length_of(mnemonic);
+        MnemonicEntry &entry = table.entries[hash_mnemonic(mnemonic, length, table.seed)];
+        if (entry.mnemonic != nullptr) {
+            return false;
+        }
+        entry = {mnemonic, length, offset, is_forward};
+        return true;
+    }
+
+    [[nodiscard]] constexpr MnemonicTable build_mnemonic_table() noexcept {
+        for (uint32_t seed = 2166136261u;; seed++) {
+            MnemonicTable table;
+            table.seed = seed;
+
+            bool collided = false;
+            for (size_t offset = 0; offset < INSTRUCTION_COUNT && !collided; offset++) {
+                const InstructionData &instruction = KNOWN_INSTRUCTIONS[offset];
+                collided = !insert_mnemonic(table, instruction.fw_mnemonic, offset, true);
+                // Self-inverse instructions are recognized as their forward variant.
+                if (!collided && !equal_mnemonics(instruction.fw_mnemonic, instruction.bw_mnemonic)) {
+                    collided = !insert_mnemonic(table, instruction.bw_mnemonic, offset, false);
+                }
+            }
+
+            if (!collided) {
+                return table;
+            }
+        }
+    }
+
+    constexpr MnemonicTable MNEMONICS = build_mnemonic_table();
+}
+
+extern "C" bool lookupMnemonic(const char *text, size_t length, size_t *offset, bool *is_forward) {
+    const MnemonicEntry &entry = MNEMONICS.entries[hash_mnemonic(text, length, MNEMONICS.seed)];
+    if (entry.mnemonic == nullptr || entry.length != length || std::memcmp(entry.mnemonic, text, length) != 0) {
+        return false;
+    }
+
+    *offset = entry.offset;
+    *is_forward = entry.is_forward;
+    return true;
+}
@@ -1,7 +1,4 @@
 %{
-// Allow larger programs to be parsed.
-#define YYMAXDEPTH 1000000
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <inttypes.h>
@@ -16,7 +13,9 @@ void yyerror(ParsedProgram* program, unsigned int *detected_errors, const char *
 extern int yylineno; // Use internal counter for errors
 static int linenumber = 1; // and count an extra one for parsed Line instances.
 
-static void preprendList(Line line);
+static void appendToSection(Line line);
+
+static void appendExports(StringList *symbols);
 
 static void setupParser();
 
@@ -52,7 +51,6 @@ static void finishProgram(ParsedProgram* program);
     StringList       *strings;
 
     Line             line;
-    LineList *       lines;
 }
 
 %token  PLUS        "+"
@@ -64,6 +62,7 @@ static void finishProgram(ParsedProgram* program);
         DOT_WORD    ".word"
         DOT_SET     ".set"
         DOT_RESERVED    ".reserved_word"
+        DOT_EXPORT  ".export"
         DIRECTIVE   "unknown directive"
 
 %token <number> NUMBER      "number"
@@ -71,11 +70,11 @@ static void finishProgram(ParsedProgram* program);
 %token <string> IDENTIFIER  "identifier"
 %token <instruction> INSTRUCTION "instruction"
 
-%type program file lines
+%type program file lines export
 %type <line>    line
 %type <line>    instruction reserved_words words set_value any_line
 
-%type <strings>  labels
+%type <strings>  labels label_lines symbols
 %type <operands> operands
 
 %type <operand> operand
@@ -89,24 +88,35 @@ static void finishProgram(ParsedProgram* program);
 
 %%
 
+// All repetitions are parsed left-recursive, so the parser stack depth
+// does not depend on the length of the program.
+
 // endofline ::= LINEBREAK +
 
-endofline : LINEBREAK endofline
+endofline : endofline LINEBREAK
             { linenumber++; }
           | LINEBREAK
             { linenumber++; }
           ;
 
 // labels ::= (LABEL (endofline LABEL)*)? endofline?
+// Labels are collected in reverse order and reversed once the line is complete.
 
-labels : LABEL endofline labels
-            { $$ = prependString($1, $3); }
+labels : label_lines LABEL
+            { $$ = prependString($2, $1); }
+       | label_lines
        | LABEL
             { $$ = prependString($1, emptyStringList()); }
        |
             { $$ = emptyStringList(); }
        ;
 
+label_lines : label_lines LABEL endofline
+                { $$ = prependString($2, $1); }
+            | LABEL endofline
+                { $$ = prependString($1, emptyStringList()); }
+            ;
+
 
 
 primitive : IDENTIFIER
@@ -134,8 +144,10 @@ operand : primitive
         ;
 
 
-operands : operand operands
-            { $$ = prependOperand($1, $2); }
+// Operands are collected in reverse order and reversed by the enclosing rule.
+
+operands : operands operand
+            { $$ = prependOperand($2, $1); }
          |
             { $$ = emptyOperandList(); }
          ;
@@ -153,13 +165,25 @@ reserved_words : DOT_RESERVED operand
                ;
 
 words : DOT_WORD operands
-        { $$ = mkWords($2); }
+        { $$ = mkWords(reverseOperands($2)); }
       ;
 
 set_value : DOT_SET operand operand
             { $$ = mkSetValue($2, $3); }
           ;
 
+// Exported symbols are collected in reverse order, since their order does not matter.
+
+symbols : symbols IDENTIFIER
+            { $$ = prependString($2, $1); }
+        | IDENTIFIER
+            { $$ = prependString($1, emptyStringList()); }
+        ;
+
+export : DOT_EXPORT symbols
+            { appendExports($2); }
+       ;
+
 any_line : instruction
          | reserved_words
          | words
@@ -167,22 +191,30 @@ any_line : instruction
          ;
 
 line : labels any_line
-        { $2.labels = $1; $2.linenumber = linenumber; $$ = $2; }
+        { $2.labels = reverseStrings($1); $2.linenumber = linenumber; $$ = $2; }
      ;
 
 
 
-lines : line endofline lines
-        { preprendList($1); }
-      | error endofline lines
-      | line
-        { preprendList($1); }
+// lines ::= ((line | error)? LINEBREAK)*
+// Every completed line is appended to its section right away.
+
+lines : lines line LINEBREAK
+        { appendToSection($2); linenumber++; }
+      | lines export LINEBREAK
+        { linenumber++; }
+      | lines error LINEBREAK
+        { linenumber++; }
+      | lines LINEBREAK
+        { linenumber++; }
       |
         {  }
       ;
 
-file : endofline lines
-     | lines
+file : lines
+     | lines line
+        { appendToSection($2); }
+     | lines export
      ;
 
 program : { setupParser(); } file { if (yynerrs > 0) {
@@ -203,38 +235,53 @@ void yyerror(ParsedProgram* program, unsigned int *detected_errors, const char *
 
 
 // Static buffers for different program sections.
-static LineList *code, *data, *bss;
+static LineBuffer code, data, bss;
+static StringList *exports;
 
 static void setupParser() {
-    code = emptyLineList();
-    data = emptyLineList();
-    bss = emptyLineList();
+    code = emptyLineBuffer();
+    data = emptyLineBuffer();
+    bss = emptyLineBuffer();
+    exports = emptyStringList();
+
+    linenumber = 1;
+    yylineno = 1;
 }
 
 static void finishProgram(ParsedProgram* program) {
     program->code = code;
     program->data = data;
     program->bss = bss;
+    program->exports = exports;
 }
 
-static void preprendList(Line line) {
-    LineList **list;
+static void appendExports(StringList *symbols) {
+    while (!symbols->isEmpty) {
+        StringList *tail = symbols->tail;
+        symbols->tail = exports;
+        exports = symbols;
+        symbols = tail;
+    }
+}
+
+static void appendToSection(Line line) {
+    LineBuffer *buffer;
     switch (line.variant) {
         case LINE_RESERVED:
-            list = &bss;
+            buffer = &bss;
             break;
 
         case LINE_WORDS:
-            list = &data;
+            buffer = &data;
             break;
 
         case LINE_SET:
-            list = &data;
+            buffer = &data;
             break;
 
         default:
-            list = &code;
+            buffer = &code;
             break;
     }
-    *list = prependLine(line, *list);
-}
\ No newline at end of file
+    appendLine(buffer, line);
+}
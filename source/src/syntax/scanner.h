@@ -2,7 +2,27 @@
 
 #include <stdio.h> // NOLINT(modernize-deprecated-headers) <-- scanner is compiled as C file, so stdio.h is required.
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 extern FILE *yyin;
 extern char *yytext;
 
 int yylex();
+
+struct yy_buffer_state;
+
+/**
+ * Scans a buffer in place. The last two bytes of the buffer must be NUL.
+ */
+struct yy_buffer_state *yy_scan_buffer(char *base, size_t size);
+
+/**
+ * Releases all buffers of the scanner, resetting it to its initial state.
+ */
+int yylex_destroy();
+
+#ifdef __cplusplus
+}
+#endif
@@ -2,6 +2,10 @@
 #include <string>
 #include <stdexcept>
 #include <filesystem>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "syntax.h"
 #include "instructions.h"
@@ -15,52 +19,133 @@ static void initialize_instruction(Instruction &instruction) noexcept {
 }
 
 /**
- * Consumes a LineList, filling its element into a std::vector.
- * All LineList nodes are freed during this operation.
+ * Consumes a LineBuffer, moving its elements into a std::vector.
+ * The buffer is freed during this operation.
  */
-static void toVector(std::vector<Line> &vector, LineList *list) noexcept {
-    size_t size = 0;
-    for (LineList *head = list; !head->isEmpty; head = head->tail) {
-        size++;
-    }
-
-    vector.reserve(size);
-    while (!list->isEmpty) {
-        vector.push_back(list->head);
-
-        LineList *ptr = list;
-        list = list->tail;
-        free(ptr);
-    }
+static void toVector(std::vector<Line> &vector, LineBuffer &buffer) noexcept {
+    vector.assign(buffer.lines, buffer.lines + buffer.size);
+    freeLineBuffer(&buffer);
 }
 
 Program::Program(ParsedProgram parsed_program) noexcept {
     toVector(this->code, parsed_program.code);
     toVector(this->data, parsed_program.data);
     toVector(this->bss, parsed_program.bss);
+    for (StringList *list = parsed_program.exports; !list->isEmpty; list = list->tail) {
+        this->exports.push_back(list->head);
+    }
 }
 
-[[nodiscard]] Program parse_file(const std::string &filename) {
-    std::filesystem::path path = std::filesystem::absolute(filename);
+/**
+ * A regular file mapped into memory, followed by the two NUL bytes required
+ * by the scanner to scan it in place. The mapping is private, so changes
+ * made by the scanner are not written back.
+ */
+class MappedFile {
+    char *base = nullptr;
+    size_t mapped_size = 0;
+    size_t file_size = 0;
+
+public:
+    /**
+     * Maps the file, if it is a regular file. Otherwise the mapping stays empty.
+     */
+    explicit MappedFile(int fd) {
+        struct stat file_status{};
+        if (fstat(fd, &file_status) != 0 || !S_ISREG(file_status.st_mode)) {
+            return;
+        }
 
-    yyin = fopen(path.c_str(), "r");
-    if (yyin == nullptr) {
-        throw std::invalid_argument("File " + path.string() + " cannot be opened.");
-    } else {
-        ParsedProgram program;
-        unsigned int detected_errors = 0;
+        // Reserve zeroed memory with room for the terminating NUL bytes and map the file over it.
+        const size_t page_size = sysconf(_SC_PAGESIZE);
+        file_size = file_status.st_size;
+        mapped_size = (file_size + 2 + page_size - 1) / page_size * page_size;
 
-        if (yyparse(&program, &detected_errors) != 0 || detected_errors > 0) {
-            throw parse_error(detected_errors);
+        void *reserved = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (reserved == MAP_FAILED) {
+            return;
         }
+        if (file_size > 0 &&
+            mmap(reserved, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+            munmap(reserved, mapped_size);
+            return;
+        }
+        base = static_cast<char *>(reserved);
+        madvise(base, mapped_size, MADV_SEQUENTIAL);
+    }
+
+    MappedFile(const MappedFile &) = delete;
 
-        for (LineList *list = program.code; !list->isEmpty; list = list->tail) {
-            if (list->head.variant == LINE_INSTRUCTION) {
-                initialize_instruction(list->head.value.instruction);
-            }
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+        if (base != nullptr) {
+            munmap(base, mapped_size);
         }
+    }
 
-        return Program(program);
+    [[nodiscard]] bool is_mapped() const { return base != nullptr; }
+
+    [[nodiscard]] char *data() const { return base; }
+
+    [[nodiscard]] size_t size() const { return file_size + 2; }
+};
+
+[[nodiscard]] static Program parse_current_input() {
+    ParsedProgram program;
+    unsigned int detected_errors = 0;
+
+    const int result = yyparse(&program, &detected_errors);
+    yylex_destroy();
+    if (result != 0 || detected_errors > 0) {
+        throw parse_error(detected_errors);
+    }
+
+    for (size_t i = 0; i < program.code.size; i++) {
+        if (program.code.lines[i].variant == LINE_INSTRUCTION) {
+            initialize_instruction(program.code.lines[i].value.instruction);
+        }
+    }
+
+    return Program(program);
+}
+
+[[nodiscard]] Program parse_file(const std::string &filename) {
+    if (filename == STDIN_FILENAME) {
+        // Streamed input is scanned incrementally.
+        yyin = stdin;
+        return parse_current_input();
+    }
+
+    std::filesystem::path path = std::filesystem::absolute(filename);
+
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::invalid_argument("File " + path.string() + " cannot be opened.");
+    }
+
+    MappedFile mapped_file(fd);
+    if (mapped_file.is_mapped()) {
+        close(fd);
+        yy_scan_buffer(mapped_file.data(), mapped_file.size());
+        return parse_current_input();
+    }
+
+    // Files that cannot be mapped (like named pipes) are read through stdio.
+    // The stream is kept, since the scanner resets yyin when it is destroyed.
+    FILE *stream = fdopen(fd, "r");
+    if (stream == nullptr) {
+        close(fd);
+        throw std::invalid_argument("File " + path.string() + " cannot be opened.");
+    }
+    yyin = stream;
+    try {
+        Program program = parse_current_input();
+        fclose(stream);
+        return program;
+    } catch (...) {
+        fclose(stream);
+        throw;
     }
 }
 
@@ -14,11 +14,24 @@ struct Program {
     Section code;
     Section data;
     Section bss;
+    /**
+     * Symbols made visible to other modules with the .export directive.
+     */
+    std::vector<const char *> exports;
 
 public:
     explicit Program(ParsedProgram parsed_program) noexcept;
 };
 
+/**
+ * The filename used to read a program from standard input.
+ */
+constexpr const char *STDIN_FILENAME = "-";
+
+/**
+ * Parses the given file. Regular files are mapped into memory and scanned in place,
+ * while STDIN_FILENAME reads the program from standard input.
+ */
 [[nodiscard]] Program parse_file(const std::string &filename);
 
 
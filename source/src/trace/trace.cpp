@@ -0,0 +1,235 @@
+
+#include <cstring>
+#include <stdexcept>
+#include "trace.h"
+#include "syntax/instructions.h"
+
+namespace Trace {
+
+    Writer::Writer(const std::string &filename) :
+            buffer(new uint8_t[CAPACITY]), head(0), tail(0), closed(false),
+            file(fopen(filename.c_str(), "wb")) {
+        if (file == nullptr) {
+            throw std::invalid_argument("File " + filename + " cannot be opened for writing.");
+        }
+        flusher = std::thread(&Writer::flush_continuously, this);
+    }
+
+    Writer::~Writer() {
+        close();
+    }
+
+    void Writer::write(const uint8_t *data, size_t size) {
+        const size_t current_head = head.load(std::memory_order_relaxed);
+        while (CAPACITY - (current_head - tail.load(std::memory_order_acquire)) < size) {
+            std::this_thread::yield(); // Wait for flusher to make room.
+        }
+
+        for (size_t index = 0; index < size; index++) {
+            buffer[(current_head + index) & (CAPACITY - 1)] = data[index];
+        }
+        head.store(current_head + size, std::memory_order_release);
+    }
+
+    void Writer::flush_continuously() {
+        while (true) {
+            // Check for closing before reading head, so no data written before closing is missed.
+            const bool was_closed = closed.load(std::memory_order_acquire);
+            const size_t current_tail = tail.load(std::memory_order_relaxed);
+            const size_t current_head = head.load(std::memory_order_acquire);
+
+            if (current_tail == current_head) {
+                if (was_closed) break;
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                continue;
+            }
+
+            const size_t start = current_tail & (CAPACITY - 1);
+            const size_t length = std::min(current_head - current_tail, CAPACITY - start);
+            fwrite(buffer.get() + start, 1, length, file);
+            tail.store(current_tail + length, std::memory_order_release);
+        }
+    }
+
+    void Writer::close() {
+        if (flusher.joinable()) {
+            closed.store(true, std::memory_order_release);
+            flusher.join();
+            fclose(file);
+        }
+    }
+
+
+    static size_t put_unsigned(uint8_t *output, uint64_t value) {
+        size_t size = 0;
+        while (value >= 0x80) {
+            output[size++] = static_cast<uint8_t>(value | 0x80);
+            value >>= 7;
+        }
+        output[size++] = static_cast<uint8_t>(value);
+        return size;
+    }
+
+    static size_t put_signed(uint8_t *output, int32_t value) {
+        const auto zigzag = (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+        return put_unsigned(output, zigzag);
+    }
+
+    static int32_t binary_for(const char *mnemonic) {
+        for (const auto &instruction: KNOWN_INSTRUCTIONS) {
+            if (strcmp(instruction.fw_mnemonic, mnemonic) == 0) return instruction.binary;
+        }
+        throw std::domain_error("Unknown instruction mnemonic!");
+    }
+
+    uint64_t code_hash(const std::vector<int32_t> &code) {
+        // FNV-1a over all instructions.
+        uint64_t hash = 0xCBF29CE484222325;
+        for (const int32_t instruction: code) {
+            hash ^= static_cast<uint32_t>(instruction);
+            hash *= 0x100000001B3;
+        }
+        return hash;
+    }
+
+    static void write_header(Writer &writer, int32_t entry_address, const std::vector<int32_t> &code) {
+        uint8_t header[sizeof(MAGIC) + 1 + 5 + 10 + 10];
+        memcpy(header, MAGIC, sizeof(MAGIC));
+        header[sizeof(MAGIC)] = VERSION;
+        size_t size = sizeof(MAGIC) + 1 + put_signed(header + sizeof(MAGIC) + 1, entry_address);
+        size += put_unsigned(header + size, code.size());
+        size += put_unsigned(header + size, code_hash(code));
+        writer.write(header, size);
+    }
+
+    static void write_event(Writer &writer, EventKind kind, uint64_t steps, int32_t br) {
+        uint8_t event[1 + 10 + 5];
+        event[0] = kind;
+        size_t size = 1 + put_unsigned(event + 1, steps);
+        size += put_signed(event + size, br);
+        writer.write(event, size);
+    }
+
+    static void write_end(Writer &writer, uint64_t steps, EndStatus status) {
+        uint8_t event[1 + 10 + 1];
+        event[0] = END;
+        size_t size = 1 + put_unsigned(event + 1, steps);
+        event[size++] = status;
+        writer.write(event, size);
+    }
+
+    void run_with_tracer(Machine::VM &vm, Writer &writer) {
+        const int32_t call_binary = binary_for("call");
+
+        write_header(writer, vm.pc, vm.program);
+
+        uint64_t steps = 0; // Instructions executed since last event.
+        try {
+            do {
+                const int32_t pc = vm.pc;
+                const int32_t br = vm.br;
+                const Machine::Direction dir = vm.dir;
+
+                vm.step();
+
+                if (vm.dir != dir) {
+                    write_event(writer, DIRECTION, steps, vm.br);
+                    steps = 0;
+                } else if (vm.br != br) {
+                    const int32_t opcode = (vm.program[pc] >> OPERAND_WIDTH) & OPCODE_WIDTH_MASK;
+                    const bool is_call = (opcode & ~DIRECTION_BIT) == call_binary;
+                    write_event(writer, is_call ? CALL : BRANCH, steps, vm.br);
+                    steps = 0;
+                } else {
+                    steps++;
+                }
+            } while (vm.running);
+        } catch (...) {
+            write_end(writer, steps, FAILED);
+            throw;
+        }
+        write_end(writer, steps, HALTED);
+    }
+
+
+    static bool get_unsigned(FILE *file, uint64_t &value) {
+        value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            const int byte = getc(file);
+            if (byte == EOF) return false;
+
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) return true;
+        }
+        return false;
+    }
+
+    static bool get_signed(FILE *file, int32_t &value) {
+        uint64_t zigzag;
+        if (!get_unsigned(file, zigzag)) return false;
+        value = static_cast<int32_t>((zigzag >> 1) ^ -(zigzag & 1));
+        return true;
+    }
+
+    Summary decode(const std::string &filename, const std::vector<int32_t> *code,
+                   const std::function<void(const Step &)> &action) {
+        std::unique_ptr<FILE, int (*)(FILE *)> file(fopen(filename.c_str(), "rb"), fclose);
+        if (file == nullptr) {
+            throw std::invalid_argument("File " + filename + " cannot be opened.");
+        }
+
+        char magic[sizeof(MAGIC)];
+        int32_t pc;
+        uint64_t code_size, hash;
+        if (fread(magic, 1, sizeof(magic), file.get()) != sizeof(magic) || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            getc(file.get()) != VERSION || !get_signed(file.get(), pc) ||
+            !get_unsigned(file.get(), code_size) || !get_unsigned(file.get(), hash)) {
+            throw std::invalid_argument("File " + filename + " is not a supported trace.");
+        }
+        if (code != nullptr && (code_size != code->size() || hash != code_hash(*code))) {
+            throw std::invalid_argument("Trace " + filename + " was not recorded for the given program. Load it "
+                                        "with the options -O, -O2 and -D it was traced with.");
+        }
+
+        Summary summary{TRUNCATED, 0, {}, 0};
+        Machine::Direction dir = Machine::Forward;
+        int32_t br = 0;
+
+        const auto execute = [&]() {
+            if (action) action({pc, dir});
+            pc += dir * (br == 0 ? 1 : br);
+            summary.steps++;
+        };
+
+        while (true) {
+            const int tag = getc(file.get());
+            uint64_t steps;
+            if (tag == EOF || tag > END || !get_unsigned(file.get(), steps)) break;
+
+            for (uint64_t step = 0; step < steps; step++) {
+                execute();
+            }
+
+            if (tag == END) {
+                const int status = getc(file.get());
+                if (status == HALTED || status == FAILED) {
+                    summary.status = static_cast<EndStatus>(status);
+                }
+                break;
+            }
+
+            int32_t new_br;
+            if (!get_signed(file.get(), new_br)) break;
+
+            summary.events[tag]++;
+            if (action) action({pc, dir});
+            br = new_br;
+            if (tag == DIRECTION) dir = !dir;
+            pc += dir * (br == 0 ? 1 : br);
+            summary.steps++;
+        }
+
+        summary.final_pc = pc;
+        return summary;
+    }
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+/**
+ * This header provides a compact binary execution trace for the virtual machine.
+ *
+ * Instead of logging every executed instruction, only changes of the branching
+ * register and of the execution direction are recorded, together with the
+ * amount of instructions executed since the previous change. Since the program
+ * counter is only ever advanced using these two registers, the complete sequence
+ * of executed addresses can be reconstructed from the trace.
+ *
+ * A trace consists of a header followed by a stream of events:
+ *  - The header holds the magic bytes "RSMT", a format version and the entry address,
+ *    followed by the size and a hash of the traced code. A trace is only decoded
+ *    against the code it was recorded for.
+ *  - Every event starts with a tag byte, followed by the amount of instructions
+ *    executed before the event's instruction. Events for branches, calls and
+ *    direction changes carry the new value of the branching register.
+ *  - The stream is terminated by an end event, stating whether the machine halted
+ *    or whether the instruction following the last executed one failed.
+ *
+ * Numbers are stored as LEB128 variable-length integers, signed numbers are
+ * zigzag-encoded beforehand.
+ */
+
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "machine/machine.h"
+
+namespace Trace {
+
+    constexpr char MAGIC[] = {'R', 'S', 'M', 'T'};
+    constexpr uint8_t VERSION = 2;
+
+    enum EventKind : uint8_t {
+        /**
+         * The branching register was changed by branch, brt or brf.
+         */
+        BRANCH = 0,
+        /**
+         * The branching register was changed by call.
+         */
+        CALL = 1,
+        /**
+         * The execution direction was inverted by uncall.
+         */
+        DIRECTION = 2,
+        /**
+         * The trace ends.
+         */
+        END = 3
+    };
+
+    enum EndStatus : uint8_t {
+        /**
+         * The machine executed a stop instruction.
+         */
+        HALTED = 0,
+        /**
+         * Executing the instruction following the last recorded one failed.
+         */
+        FAILED = 1,
+        /**
+         * The trace ends without end event, e.g. because the recording process was killed.
+         * Only reported when decoding a trace.
+         */
+        TRUNCATED = 2
+    };
+
+    /**
+     * A single-producer single-consumer byte queue, flushed to a file by a
+     * background thread. The executing thread only blocks if the queue is full.
+     */
+    class Writer {
+        static constexpr size_t CAPACITY = 1 << 20;
+
+        std::unique_ptr<uint8_t[]> buffer;
+        alignas(64) std::atomic<size_t> head;
+        alignas(64) std::atomic<size_t> tail;
+        std::atomic<bool> closed;
+        FILE *file;
+        std::thread flusher;
+
+        void flush_continuously();
+
+    public:
+        explicit Writer(const std::string &filename);
+
+        ~Writer();
+
+        Writer(const Writer &) = delete;
+
+        Writer &operator=(const Writer &) = delete;
+
+        void write(const uint8_t *data, size_t size);
+
+        /**
+         * Flushes all pending data and closes the file.
+         */
+        void close();
+    };
+
+    /**
+     * Executes the program loaded into the machine, recording a trace with the given Writer.
+     */
+    void run_with_tracer(Machine::VM &vm, Writer &writer);
+
+
+    struct Step {
+        int32_t pc;
+        Machine::Direction dir;
+    };
+
+    struct Summary {
+        EndStatus status;
+        uint64_t steps;
+        uint64_t events[END];
+        /**
+         * The address of the instruction following the last executed one.
+         */
+        int32_t final_pc;
+    };
+
+    /**
+     * Returns the hash identifying the traced code in the header of a trace.
+     */
+    [[nodiscard]] uint64_t code_hash(const std::vector<int32_t> &code);
+
+    /**
+     * Decodes a trace file, invoking the given action for every executed instruction.
+     * The action may be empty, if only the summary is of interest. If the traced code
+     * is given, the trace must have been recorded for exactly this code.
+     */
+    Summary decode(const std::string &filename, const std::vector<int32_t> *code,
+                   const std::function<void(const Step &)> &action);
+}
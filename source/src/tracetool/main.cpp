@@ -0,0 +1,149 @@
+/**
+ * Program entry point for an auxiliary executable, that decodes execution
+ * traces recorded with the --trace option of the virtual machine.
+ *
+ * The decoded trace is printed as a sequence of executed addresses and
+ * their execution directions. If the traced program is given as well,
+ * addresses are described using the nearest label and a summary of
+ * executed instructions per label can be printed.
+ */
+
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <tuple>
+#include <vector>
+#include "assembler/assembler.h"
+#include "messages/error.h"
+#include "optimizer/optimizer.h"
+#include "profile/source_map.h"
+#include "trace/trace.h"
+
+using std::cout, std::cerr, std::endl;
+
+static const char *help_page =
+        "Supported options are:\n"
+        " -h, --help\n"
+        "    Print this help page and exit.\n"
+        " -s, --summary\n"
+        "    Print a summary of executed instructions per label instead of the\n"
+        "    sequence of executed instructions. Requires the traced PROGRAM.\n"
+        " -O, --optimize\n"
+        " -O2\n"
+        " -D, --define [SYMBOL=VALUE]\n"
+        "    Load PROGRAM like stackmachine does with these options. They must match\n"
+        "    the options the trace was recorded with.\n"
+        "\n"
+        "If PROGRAM is given, every executed address is printed together with its\n"
+        "location relative to the nearest label. The trace is rejected if it was\n"
+        "not recorded for PROGRAM.";
+
+struct LabelSummary {
+    uint64_t forward = 0;
+    uint64_t backward = 0;
+};
+
+static const char *status_description(Trace::EndStatus status) {
+    switch (status) {
+        case Trace::HALTED:
+            return "halted";
+        case Trace::FAILED:
+            return "failed";
+        default:
+            return "truncated";
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *trace_file = nullptr, *program_file = nullptr;
+    bool should_summarize = false;
+    unsigned optimization_level = 0;
+    std::vector<Optimizer::ConstantOverride> overrides;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            cout << "Decodes execution traces of the reversible stack machine.\n\n";
+            cout << "  " << argv[0] << " [OPTIONS] TRACE [PROGRAM]\n\n";
+            cout << help_page << endl;
+            return 0;
+        } else if (strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--summary") == 0) {
+            should_summarize = true;
+        } else if (strcmp(argv[i], "-O") == 0 || strcmp(argv[i], "--optimize") == 0) {
+            optimization_level = 1;
+        } else if (strcmp(argv[i], "-O2") == 0) {
+            optimization_level = 2;
+        } else if (i + 1 < argc && (strcmp(argv[i], "-D") == 0 || strcmp(argv[i], "--define") == 0)) {
+            Optimizer::ConstantOverride override;
+            if (!Optimizer::parse_override(argv[++i], override)) {
+                cerr << "Invalid constant definition: " << argv[i] << endl;
+                return 2;
+            }
+            overrides.push_back(override);
+        } else if (trace_file == nullptr) {
+            trace_file = argv[i];
+        } else if (program_file == nullptr) {
+            program_file = argv[i];
+        } else {
+            cerr << "Unexpected argument: " << argv[i] << endl;
+            return 2;
+        }
+    }
+    if (trace_file == nullptr || (should_summarize && program_file == nullptr)) {
+        cerr << "Missing trace or program file. See --help for usage." << endl;
+        return 2;
+    }
+
+    try {
+        std::optional<Program> program;
+        std::optional<Profiler::SourceMap> source_map;
+        std::vector<int32_t> code;
+        if (program_file != nullptr) {
+            // Loaded like stackmachine does, so addresses match the traced code.
+            program.emplace(parse_file(program_file));
+            Optimizer::override_constants(program.value(), overrides);
+            for (const auto &override: overrides) {
+                if (!override.is_applied) throw undefined_constant(override.symbol);
+            }
+            if (optimization_level >= 2) (void) Optimizer::inline_procedures(program.value());
+            if (optimization_level >= 1) (void) Optimizer::eliminate_redundant_instructions(program.value());
+            code = std::get<1>(Assembler::assemble(program.value())); // Also assigns addresses to lines.
+            source_map.emplace(program.value());
+        }
+
+        std::map<std::string, LabelSummary> labels;
+        const Trace::Summary summary = Trace::decode(trace_file, program.has_value() ? &code : nullptr,
+                                                     [&](const Trace::Step &step) {
+            if (should_summarize) {
+                const auto &location = source_map->at(step.pc);
+                LabelSummary &label = labels[location.label != nullptr ? location.label : "<no label>"];
+                if (step.dir == Machine::Forward) label.forward++;
+                else label.backward++;
+            } else {
+                cout << step.pc << (step.dir == Machine::Forward ? " F" : " B");
+                if (source_map.has_value()) {
+                    cout << " " << source_map->describe(step.pc);
+                }
+                cout << "\n";
+            }
+        });
+
+        if (should_summarize) {
+            cout << "label forward backward\n";
+            for (const auto &[name, label]: labels) {
+                cout << name << " " << label.forward << " " << label.backward << "\n";
+            }
+        }
+
+        cerr << "Decoded " << summary.steps << " instructions with "
+             << summary.events[Trace::BRANCH] << " branches, "
+             << summary.events[Trace::CALL] << " calls and "
+             << summary.events[Trace::DIRECTION] << " direction changes. Execution "
+             << status_description(summary.status) << " at " << summary.final_pc << "." << endl;
+        return 0;
+
+    } catch (std::exception &exception) {
+        cerr << "[ERROR] " << exception.what() << endl;
+        return 1;
+    }
+}